@@ -19,6 +19,10 @@ struct cli_options {
   display_options display;
   bool include_instructions{true};
   bool strings{false};
+  bool incremental{false};
+  bool skip_identical{false};
+  size_t threads{0};
+  std::string cache_directory;
   std::string primary_path;
   std::string secondary_path;
 };
@@ -26,8 +30,8 @@ struct cli_options {
 void print_usage(std::string_view executable) {
   std::println(
     stderr,
-    "Usage: {} [--summary] [--strings] [--no-instructions] [--show-unchanged] [--limit count] <primary_binary> "
-    "<secondary_binary>",
+    "Usage: {} [--summary] [--strings] [--no-instructions] [--show-unchanged] [--limit count] [--cache directory] "
+    "[--incremental] [--skip-identical] [--threads count] <primary_binary> <secondary_binary>",
     executable
   );
 }
@@ -47,19 +51,28 @@ auto parse_args(int argc, char* argv[]) -> std::optional<cli_options> {
       options.include_instructions = false;
     } else if (arg == "--show-unchanged") {
       options.display.show_unchanged = true;
-    } else if (arg == "--limit") {
+    } else if (arg == "--limit" || arg == "--threads") {
       if (i + 1 >= argc) {
         return std::nullopt;
       }
       const std::string_view value(argv[++i]);
-      size_t parsed_limit = 0;
+      size_t parsed_count = 0;
       const auto* begin = value.data();
       const auto* end = value.data() + value.size();
-      auto [ptr, ec] = std::from_chars(begin, end, parsed_limit);
+      auto [ptr, ec] = std::from_chars(begin, end, parsed_count);
       if (ec != std::errc{} || ptr != end) {
         return std::nullopt;
       }
-      options.display.limit = parsed_limit;
+      (arg == "--limit" ? options.display.limit : options.threads) = parsed_count;
+    } else if (arg == "--incremental") {
+      options.incremental = true;
+    } else if (arg == "--skip-identical") {
+      options.skip_identical = true;
+    } else if (arg == "--cache") {
+      if (i + 1 >= argc) {
+        return std::nullopt;
+      }
+      options.cache_directory = argv[++i];
     } else if (arg == "--help" || arg == "-h") {
       return std::nullopt;
     } else if (arg.starts_with('-')) {
@@ -94,7 +107,8 @@ auto trim_string(std::string_view value) -> std::string_view {
 
 void print_string(char op, const strings::entry& entry) {
   const auto suffix = entry.value.size() > trim_string(entry.value).size() ? "..." : "";
-  std::println("{} {:08x} {} {}{}", op, entry.address, entry.section, trim_string(entry.value), suffix);
+  const auto* encoding = entry.wide ? " wide" : "";
+  std::println("{} {:08x} {}{} {}{}", op, entry.address, entry.section, encoding, trim_string(entry.value), suffix);
   if (!entry.xrefs.empty()) {
     std::print("    xrefs:");
     for (const auto xref : entry.xrefs) {
@@ -189,6 +203,9 @@ void print_results(const binary_differ::diff_result& result, const display_optio
   if (result.skipped_candidates > 0) {
     std::println("skipped broad match candidates: {}", result.skipped_candidates);
   }
+  if (result.prefiltered_candidates > 0) {
+    std::println("prefiltered candidates (score bound below the threshold): {}", result.prefiltered_candidates);
+  }
 
   if (options.summary_only) {
     return;
@@ -291,6 +308,10 @@ int main(int argc, char* argv[]) {
 
     binary_differ::compare_options diff_options;
     diff_options.include_instructions = options->include_instructions;
+    diff_options.cache_directory = options->cache_directory;
+    diff_options.incremental = options->incremental;
+    diff_options.skip_identical = options->skip_identical;
+    diff_options.worker_count = options->threads;
     binary_differ differ(options->primary_path, options->secondary_path, diff_options);
     auto result = differ.compare();
     print_results(result, options->display);
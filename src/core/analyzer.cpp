@@ -1,8 +1,12 @@
 #include "analyzer.h"
 #include <algorithm>
 #include <atomic>
+#include <bit>
 #include <cstdint>
+#include <cstring>
+#include <functional>
 #include <limits>
+#include <map>
 #include <mutex>
 #include <stack>
 #include <stdexcept>
@@ -14,6 +18,9 @@
 
 namespace {
 
+  // longest x86 instruction, a decode at the end of a range can read this far past it
+  constexpr size_t max_instruction_length = 15;
+
   [[nodiscard]] auto calculate_fingerprint(std::span<const subroutine_analyzer::basic_block> blocks) -> fingerprint {
     uint64_t hash = 14695981039346656037ull;
     auto append = [&](uint64_t value) {
@@ -69,6 +76,134 @@ namespace {
     return hash;
   }
 
+  [[nodiscard]] auto mix_hash(uint64_t value) -> uint64_t {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ull;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebull;
+    return value ^ (value >> 31);
+  }
+
+  // labels start from block contents and absorb sorted neighbour labels each round, so only the graph shape and
+  // block contents matter, never the order blocks were laid out in
+  uint64_t calculate_graph_hash(std::span<const subroutine_analyzer::basic_block> blocks, uint64_t entry_address) {
+    constexpr size_t rounds = 3;
+    std::vector<uint64_t> labels(blocks.size());
+    std::vector<std::vector<size_t>> predecessors(blocks.size());
+    for (size_t i = 0; i < blocks.size(); ++i) {
+      uint64_t label = 14695981039346656037ull;
+      hash_value(label, blocks[i].match_hash);
+      hash_value(label, blocks[i].match_keys.size());
+      hash_value(label, static_cast<uint8_t>(blocks[i].start_address == entry_address));
+      labels[i] = label;
+      for (const auto successor : blocks[i].successor_keys) {
+        predecessors[static_cast<size_t>(static_cast<int64_t>(i) + successor)].push_back(i);
+      }
+    }
+
+    std::vector<uint64_t> next(blocks.size());
+    std::vector<uint64_t> neighbours;
+    for (size_t round = 0; round < rounds; ++round) {
+      for (size_t i = 0; i < blocks.size(); ++i) {
+        auto label = mix_hash(labels[i]);
+        neighbours.clear();
+        for (const auto successor : blocks[i].successor_keys) {
+          neighbours.push_back(labels[static_cast<size_t>(static_cast<int64_t>(i) + successor)]);
+        }
+        std::ranges::sort(neighbours);
+        for (const auto neighbour : neighbours) {
+          hash_value(label, neighbour);
+        }
+        hash_value(label, uint8_t{0xff});
+        neighbours.clear();
+        for (const auto predecessor : predecessors[i]) {
+          neighbours.push_back(labels[predecessor]);
+        }
+        std::ranges::sort(neighbours);
+        for (const auto neighbour : neighbours) {
+          hash_value(label, neighbour);
+        }
+        next[i] = label;
+      }
+      labels.swap(next);
+    }
+
+    std::ranges::sort(labels);
+    uint64_t hash = 14695981039346656037ull;
+    hash_value(hash, labels.size());
+    for (const auto label : labels) {
+      hash_value(hash, label);
+    }
+    return hash;
+  }
+
+  // shingles stay inside a block so reordered blocks keep their sketch
+  std::vector<uint32_t> calculate_sketch(std::span<const subroutine_analyzer::basic_block> blocks) {
+    std::vector<uint32_t> sketch;
+    auto add_shingle = [&](uint64_t shingle) {
+      if (sketch.empty()) {
+        sketch.assign(subroutine_analyzer::sketch_size, std::numeric_limits<uint32_t>::max());
+      }
+      for (size_t i = 0; i < sketch.size(); ++i) {
+        const auto value = static_cast<uint32_t>(mix_hash(shingle + (i + 1) * 0x9e3779b97f4a7c15ull) >> 32);
+        sketch[i] = std::min(sketch[i], value);
+      }
+    };
+
+    constexpr size_t shingle_length = 3;
+    for (const auto& block : blocks) {
+      const auto& keys = block.match_keys;
+      const auto count = keys.size() < shingle_length ? std::min<size_t>(keys.size(), 1) : keys.size() - 2;
+      for (size_t i = 0; i < count; ++i) {
+        uint64_t shingle = 14695981039346656037ull;
+        for (size_t j = i; j < std::min(i + shingle_length, keys.size()); ++j) {
+          hash_value(shingle, keys[j]);
+        }
+        add_shingle(shingle);
+      }
+    }
+    return sketch;
+  }
+
+  void add_feature(subroutine_analyzer::feature_vector& features, size_t lane) {
+    auto& count = features[lane];
+    count = count == std::numeric_limits<uint16_t>::max() ? count : static_cast<uint16_t>(count + 1);
+  }
+
+  // lanes 0-7 of the feature vector
+  size_t instruction_class(const ZydisDecodedInstruction& instruction) {
+    switch (instruction.meta.category) {
+      case ZYDIS_CATEGORY_DATAXFER:
+      case ZYDIS_CATEGORY_CMOV:
+      case ZYDIS_CATEGORY_PUSH:
+      case ZYDIS_CATEGORY_POP:
+        return 0;
+      case ZYDIS_CATEGORY_BINARY:
+        return 1;
+      case ZYDIS_CATEGORY_LOGICAL:
+      case ZYDIS_CATEGORY_SHIFT:
+      case ZYDIS_CATEGORY_ROTATE:
+      case ZYDIS_CATEGORY_BITBYTE:
+      case ZYDIS_CATEGORY_SETCC:
+        return 2;
+      case ZYDIS_CATEGORY_COND_BR:
+        return 3;
+      case ZYDIS_CATEGORY_UNCOND_BR:
+      case ZYDIS_CATEGORY_RET:
+        return 4;
+      case ZYDIS_CATEGORY_CALL:
+        return 5;
+      case ZYDIS_CATEGORY_SSE:
+      case ZYDIS_CATEGORY_AVX:
+      case ZYDIS_CATEGORY_AVX2:
+      case ZYDIS_CATEGORY_AVX512:
+      case ZYDIS_CATEGORY_X87_ALU:
+        return 6;
+      default:
+        return 7;
+    }
+  }
+
   bool is_call(const ZydisDecodedInstruction& instruction) {
     return instruction.meta.category == ZYDIS_CATEGORY_CALL;
   }
@@ -88,6 +223,12 @@ namespace {
     });
   }
 
+  // small values, masks and powers of two show up in every function
+  bool is_distinctive_constant(uint64_t value) {
+    const auto magnitude = static_cast<int64_t>(value) < 0 ? ~value + 1 : value;
+    return magnitude >= 0x1000 && !std::has_single_bit(magnitude) && !std::has_single_bit(magnitude + 1);
+  }
+
   uint64_t instruction_key(
     const ZydisDecodedInstruction& instruction, const ZydisDecodedOperand* operands, bool include_values,
     std::span<const subroutine_analyzer::address_range> ranges
@@ -193,88 +334,198 @@ subroutine_analyzer::subroutine_analyzer(
 
 std::vector<subroutine_analyzer::subroutine> subroutine_analyzer::get_subroutines() {
   check_stop();
-  if (!known_starts_.empty()) {
-    std::vector<subroutine> functions(known_starts_.size());
-    auto analyze = [&](subroutine_analyzer& analyzer, size_t i) {
-      const auto end_address_hint =
-        i + 1 < known_starts_.size() ? std::optional<uint64_t>(known_starts_[i + 1]) : std::nullopt;
-      functions[i] = analyzer.analyze_subroutine(known_starts_[i], end_address_hint);
-    };
+  std::vector<subroutine> functions;
+  if (known_starts_.empty()) {
+    visit_subroutines([&](subroutine&& function) {
+      functions.push_back(std::move(function));
+    });
+    return functions;
+  }
+
+  // every worker owns its slot, so the address order costs nothing here
+  std::vector<std::optional<subroutine>> slots(known_starts_.size());
+  for_each_known_start([&](subroutine_analyzer& analyzer, size_t i) {
+    slots[i] = analyze_known_start(analyzer, i);
+  });
+  functions.reserve(slots.size());
+  for (auto& slot : slots) {
+    if (slot) {
+      functions.push_back(std::move(*slot));
+    }
+  }
+  return functions;
+}
 
-    const auto thread_count = std::min(worker_count_, known_starts_.size());
-    if (thread_count == 1) {
-      for (size_t i = 0; i < known_starts_.size(); ++i) {
-        check_stop();
-        analyze(*this, i);
+void subroutine_analyzer::visit_subroutines(const std::function<void(subroutine&&)>& visit, visit_order order) {
+  check_stop();
+  if (known_starts_.empty()) {
+    // discovered starts are sorted, so a start inside the subroutine before it is dropped without analyzing it
+    std::optional<uint64_t> covered_until;
+    for (const auto start_address : discover_subroutine_starts()) {
+      check_stop();
+      if (covered_until && start_address < *covered_until) {
+        continue;
       }
-    } else {
-      std::atomic_size_t next_index{0};
-      std::stop_source stop_source;
-      std::exception_ptr failure;
-      std::mutex failure_mutex;
-      std::vector<std::jthread> workers;
-      workers.reserve(thread_count);
-      for (size_t i = 0; i < thread_count; ++i) {
-        workers.emplace_back([&] {
-          try {
-            subroutine_analyzer analyzer(
-              data_, size_, base_address_, std::span<const uint64_t>{}, include_instructions_, 1, stop_token_,
-              address_ranges_
-            );
-            analyzer.worker_token_ = stop_source.get_token();
-            while (!stop_source.stop_requested() && !stop_token_.stop_requested()) {
-              const auto index = next_index.fetch_add(1, std::memory_order_relaxed);
-              if (index >= known_starts_.size()) {
-                break;
-              }
-              analyze(analyzer, index);
-            }
-          } catch (...) {
-            stop_source.request_stop();
-            const std::scoped_lock lock(failure_mutex);
-            if (!failure) {
-              failure = std::current_exception();
-            }
-          }
-        });
+      auto function = analyze_subroutine(start_address, std::nullopt);
+      covered_until = function.end_address;
+      if (observer_) {
+        observer_(function);
       }
-      workers.clear();
-      if (failure) {
-        std::rethrow_exception(failure);
+      visit(std::move(function));
+    }
+    return;
+  }
+
+  // address order parks subroutines that finish early until every known start before them is done
+  std::mutex visit_mutex;
+  size_t next_index = 0;
+  std::map<size_t, std::optional<subroutine>> pending;
+  for_each_known_start([&](subroutine_analyzer& analyzer, size_t i) {
+    auto function = analyze_known_start(analyzer, i);
+    const std::scoped_lock lock(visit_mutex);
+    if (order == visit_order::completion) {
+      if (function) {
+        visit(std::move(*function));
       }
-      check_stop();
+      return;
     }
+    pending.emplace(i, std::move(function));
+    for (auto it = pending.begin(); it != pending.end() && it->first == next_index; ++next_index) {
+      if (it->second) {
+        visit(std::move(*it->second));
+      }
+      it = pending.erase(it);
+    }
+  });
+}
 
-    std::erase_if(functions, [](const auto& function) {
-      return function.basic_blocks.empty() && function.byte_size == 0;
-    });
-    return functions;
+std::optional<subroutine_analyzer::subroutine>
+subroutine_analyzer::analyze_known_start(subroutine_analyzer& analyzer, size_t index) {
+  if (std::ranges::binary_search(skipped_starts_, known_starts_[index])) {
+    return std::nullopt;
   }
+  const auto end_address_hint =
+    index + 1 < known_starts_.size() ? std::optional<uint64_t>(known_starts_[index + 1]) : std::nullopt;
+  auto function = reuse_ ? analyzer.analyze_range(known_starts_[index], end_address_hint, prior_)
+                         : analyzer.analyze_subroutine(known_starts_[index], end_address_hint);
+  if (function.basic_blocks.empty() && function.byte_size == 0) {
+    return std::nullopt;
+  }
+  if (observer_) {
+    observer_(function);
+  }
+  return function;
+}
 
-  auto function_starts = discover_subroutine_starts();
-  std::vector<subroutine> functions;
-  functions.reserve(function_starts.size());
-
-  for (auto start_address : function_starts) {
-    check_stop();
-    functions.push_back(analyze_subroutine(start_address, std::nullopt));
+std::vector<subroutine_analyzer::subroutine> subroutine_analyzer::known_ranges() const {
+  const auto section_end = base_address_ + size_;
+  std::vector<subroutine> ranges(known_starts_.size());
+  for (size_t i = 0; i < known_starts_.size(); ++i) {
+    auto& range = ranges[i];
+    range.start_address = known_starts_[i];
+    range.end_address = i + 1 < known_starts_.size() ? known_starts_[i + 1] : section_end;
+    range.byte_size = static_cast<size_t>(range.end_address - range.start_address);
   }
+  return ranges;
+}
 
-  std::sort(functions.begin(), functions.end(), [](const auto& a, const auto& b) {
-    return a.start_address < b.start_address;
+std::vector<subroutine_analyzer::subroutine> subroutine_analyzer::hash_ranges() {
+  check_stop();
+  auto ranges = known_ranges();
+  for_each_known_start([&](subroutine_analyzer& analyzer, size_t i) {
+    auto& range = ranges[i];
+    if (std::ranges::binary_search(skipped_starts_, range.start_address)) {
+      return;
+    }
+    range.range_hash = analyzer.hash_range(range.start_address, range.end_address);
+    range.byte_hash = analyzer.hash_bytes(range.start_address, range.end_address);
+  });
+  std::erase_if(ranges, [&](const subroutine& range) {
+    return std::ranges::binary_search(skipped_starts_, range.start_address);
   });
+  return ranges;
+}
 
-  std::vector<subroutine> filtered_functions;
-  if (!functions.empty()) {
-    filtered_functions.push_back(functions[0]);
-    for (size_t i = 1; i < functions.size(); ++i) {
-      if (functions[i].start_address >= filtered_functions.back().end_address) {
-        filtered_functions.push_back(functions[i]);
-      }
+void subroutine_analyzer::skip_starts(std::span<const uint64_t> starts) {
+  skipped_starts_.assign(starts.begin(), starts.end());
+  std::ranges::sort(skipped_starts_);
+}
+
+void subroutine_analyzer::for_each_known_start(const std::function<void(subroutine_analyzer&, size_t)>& visit) {
+  const auto thread_count = std::min(worker_count_, known_starts_.size());
+  if (thread_count <= 1) {
+    for (size_t i = 0; i < known_starts_.size(); ++i) {
+      check_stop();
+      visit(*this, i);
     }
+    return;
+  }
+
+  std::atomic_size_t next_index{0};
+  std::stop_source stop_source;
+  std::exception_ptr failure;
+  std::mutex failure_mutex;
+  std::vector<std::jthread> workers;
+  workers.reserve(thread_count);
+  for (size_t i = 0; i < thread_count; ++i) {
+    workers.emplace_back([&] {
+      try {
+        subroutine_analyzer analyzer(
+          data_, size_, base_address_, std::span<const uint64_t>{}, include_instructions_, 1, stop_token_,
+          address_ranges_
+        );
+        analyzer.worker_token_ = stop_source.get_token();
+        while (!stop_source.stop_requested() && !stop_token_.stop_requested()) {
+          const auto index = next_index.fetch_add(1, std::memory_order_relaxed);
+          if (index >= known_starts_.size()) {
+            break;
+          }
+          visit(analyzer, index);
+        }
+      } catch (...) {
+        stop_source.request_stop();
+        const std::scoped_lock lock(failure_mutex);
+        if (!failure) {
+          failure = std::current_exception();
+        }
+      }
+    });
   }
+  workers.clear();
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+  check_stop();
+}
 
-  return filtered_functions;
+void subroutine_analyzer::observe(std::function<void(const subroutine&)> observer) {
+  observer_ = std::move(observer);
+}
+
+void subroutine_analyzer::reuse_from(
+  std::span<const subroutine> prior, std::span<const address_range> prior_ranges
+) {
+  reuse_ = true;
+  prior_.by_range_hash.clear();
+  prior_.by_range_hash.reserve(prior.size());
+  prior_.by_start.clear();
+  // address ranges decide which operands are image addresses, so equal bytes only analyze equal under equal ranges
+  const auto same_ranges =
+    !prior.empty() && std::ranges::equal(prior_ranges, address_ranges_, [](const auto& lhs, const auto& rhs) {
+      return lhs.start == rhs.start && lhs.end == rhs.end;
+    });
+  if (same_ranges) {
+    prior_.by_start.reserve(prior.size());
+  }
+  for (const auto& function : prior) {
+    // ranges paired without analysis have no blocks to copy
+    if (function.range_hash != 0 && !function.basic_blocks.empty()) {
+      prior_.by_range_hash.emplace(function.range_hash, &function);
+      if (same_ranges) {
+        prior_.by_start.emplace(function.start_address, &function);
+      }
+    }
+  }
 }
 
 void subroutine_analyzer::check_stop() const {
@@ -394,10 +645,13 @@ subroutine_analyzer::subroutine
 subroutine_analyzer::analyze_subroutine(uint64_t start_address, std::optional<uint64_t> end_address_hint) {
   subroutine function;
   function.start_address = start_address;
-  function.basic_blocks = find_basic_blocks(start_address, end_address_hint);
+  find_basic_blocks(function, end_address_hint);
 
   function.fingerprint = calculate_fingerprint(function.basic_blocks);
   function.instruction_hash = calculate_instruction_hash(function.basic_blocks);
+  function.graph_hash = calculate_graph_hash(function.basic_blocks, start_address);
+  add_block_features(function.features, function.basic_blocks);
+  function.sketch = calculate_sketch(function.basic_blocks);
   for (const auto& block : function.basic_blocks) {
     function.instruction_count += block.instruction_keys.size();
   }
@@ -411,6 +665,162 @@ subroutine_analyzer::analyze_subroutine(uint64_t start_address, std::optional<ui
   return function;
 }
 
+subroutine_analyzer::subroutine subroutine_analyzer::analyze_range(
+  uint64_t start_address, std::optional<uint64_t> end_address_hint, const prior_index& prior
+) {
+  const auto section_end = base_address_ + size_;
+  const auto end_address = std::min(end_address_hint.value_or(section_end), section_end);
+  auto has_instructions = [](const subroutine& function) {
+    return std::ranges::all_of(function.basic_blocks, [](const auto& block) {
+      return block.instructions.size() == block.instruction_keys.size();
+    });
+  };
+
+  // unchanged bytes at an unchanged address decode exactly like before, so the copy needs no decoding at all
+  const auto byte_hash = hash_bytes(start_address, end_address);
+  if (const auto it = prior.by_start.find(start_address);
+      it != prior.by_start.end() && it->second->byte_hash == byte_hash) {
+    auto function = *it->second;
+    if (!include_instructions_) {
+      for (auto& block : function.basic_blocks) {
+        block.instructions.clear();
+      }
+    } else if (!has_instructions(function)) {
+      redecode(function, true, false);
+    }
+    return function;
+  }
+
+  const auto range_hash = hash_range(start_address, end_address);
+  const auto prior_it = prior.by_range_hash.find(range_hash);
+  if (prior_it == prior.by_range_hash.end()) {
+    auto function = analyze_subroutine(start_address, end_address_hint);
+    function.range_hash = range_hash;
+    function.byte_hash = byte_hash;
+    return function;
+  }
+
+  // equal range hashes decode to the same blocks and keys, only addresses and rendered text can differ
+  auto function = *prior_it->second;
+  const auto delta = start_address - function.start_address;
+  const auto moved = delta != 0 || byte_hash != function.byte_hash;
+  const auto render = include_instructions_ && (moved || !has_instructions(function));
+
+  function.start_address += delta;
+  function.end_address += delta;
+  function.byte_hash = byte_hash;
+  for (auto& block : function.basic_blocks) {
+    block.start_address += delta;
+    block.end_address += delta;
+    if (!include_instructions_) {
+      block.instructions.clear();
+    }
+  }
+  if (render || moved) {
+    redecode(function, render, moved);
+  }
+  return function;
+}
+
+// the range plus the longest instruction that can start inside it, read a word at a time without decoding
+uint64_t subroutine_analyzer::hash_bytes(uint64_t start_address, uint64_t end_address) const {
+  const auto offset = static_cast<size_t>(start_address - base_address_);
+  const auto end = std::min(static_cast<size_t>(end_address - base_address_) + max_instruction_length, size_);
+  const auto length = end > offset ? end - offset : 0;
+  const auto* bytes = data_ + offset;
+
+  uint64_t hash = 14695981039346656037ull ^ (end_address - start_address);
+  auto mix = [&](uint64_t word) {
+    hash = std::rotl(hash ^ (word * 0x9e3779b97f4a7c15ull), 27) * 0xff51afd7ed558ccdull;
+  };
+  mix(length);
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, sizeof(word));
+    mix(word);
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, bytes + i, length - i);
+  mix(tail);
+  return hash ^ (hash >> 33);
+}
+
+uint64_t subroutine_analyzer::hash_range(uint64_t start_address, uint64_t end_address) {
+  uint64_t range_hash = 14695981039346656037ull;
+  hash_value(range_hash, end_address - start_address);
+
+  // a linear sweep over the range. the value keys already drop relocatable operands and branches only
+  // contribute where they land inside the range, so equal hashes mean find_basic_blocks would agree
+  auto current_address = start_address;
+  auto offset = start_address - base_address_;
+  while (offset < size_ && current_address < end_address) {
+    check_stop();
+    if (!decoder_.disassemble(current_address, data_ + offset, size_ - offset)) {
+      hash_value(range_hash, uint8_t{0});
+      hash_value(range_hash, data_[offset]);
+      ++offset;
+      ++current_address;
+      continue;
+    }
+
+    const auto& decoded_instruction = decoder_.get_decoded_instruction();
+    const auto* decoded_operands = decoder_.get_decoded_operands();
+    hash_value(range_hash, decoded_instruction.length);
+    hash_value(range_hash, instruction_key(decoded_instruction, decoded_operands, true, address_ranges_));
+    if (is_control_flow(decoded_instruction) && !is_call(decoded_instruction)) {
+      const auto target = get_jump_target(decoded_instruction, decoded_operands, current_address);
+      const auto local = target && *target >= start_address && *target < end_address;
+      hash_value(range_hash, local ? *target - start_address : ~uint64_t{0});
+    }
+
+    current_address += decoded_instruction.length;
+    offset += decoded_instruction.length;
+  }
+
+  return std::max<uint64_t>(range_hash, 1);
+}
+
+// a copied function may sit at another address, so its text and address dependent facts are decoded again in
+// a single pass over its blocks
+void subroutine_analyzer::redecode(subroutine& function, bool render, bool references) {
+  if (references) {
+    function.call_targets.clear();
+    function.data_refs.clear();
+    function.constants.clear();
+  }
+  for (auto& block : function.basic_blocks) {
+    if (render) {
+      block.instructions.clear();
+      block.instructions.reserve(block.instruction_keys.size());
+    }
+    auto current_address = block.start_address;
+    for (size_t i = 0; i < block.instruction_keys.size(); ++i) {
+      check_stop();
+      const auto offset = current_address - base_address_;
+      if (offset >= size_ || !decoder_.disassemble(current_address, data_ + offset, size_ - offset)) {
+        if (render) {
+          block.instructions.emplace_back("???");
+        }
+        ++current_address;
+        continue;
+      }
+      if (render) {
+        block.instructions.push_back(decoder_.get_instruction());
+      }
+      if (references) {
+        record_references(
+          function, decoder_.get_decoded_instruction(), decoder_.get_decoded_operands(), current_address
+        );
+      }
+      current_address += decoder_.get_decoded_instruction().length;
+    }
+  }
+  if (references) {
+    finish_references(function);
+  }
+}
+
 void subroutine_analyzer::set_byte_size(subroutine& function) {
   if (function.start_address < base_address_ || function.end_address <= function.start_address) {
     return;
@@ -428,9 +838,9 @@ void subroutine_analyzer::set_byte_size(subroutine& function) {
   function.byte_size = byte_count;
 }
 
-std::vector<subroutine_analyzer::basic_block>
-subroutine_analyzer::find_basic_blocks(uint64_t start_address, std::optional<uint64_t> end_address_hint) {
-  std::vector<basic_block> blocks;
+void subroutine_analyzer::find_basic_blocks(subroutine& function, std::optional<uint64_t> end_address_hint) {
+  const auto start_address = function.start_address;
+  auto& blocks = function.basic_blocks;
   std::unordered_map<uint64_t, std::vector<uint64_t>> block_successors;
   std::unordered_set<uint64_t> processed_addresses;
   const auto section_end = base_address_ + size_;
@@ -474,6 +884,8 @@ subroutine_analyzer::find_basic_blocks(uint64_t start_address, std::optional<uin
       block.instruction_keys.push_back(key);
       block.match_keys.push_back(match_key);
       hash_value(block.match_hash, match_key);
+      record_references(function, decoded_instruction, decoded_operands, current_address);
+      add_feature(function.features, instruction_class(decoded_instruction));
 
       if (is_control_flow(decoded_instruction)) {
         if (is_return(decoded_instruction)) {
@@ -544,7 +956,57 @@ subroutine_analyzer::find_basic_blocks(uint64_t start_address, std::optional<uin
       }
     }
   }
-  return blocks;
+  finish_references(function);
+}
+
+void subroutine_analyzer::record_references(
+  subroutine& function, const ZydisDecodedInstruction& instruction, const ZydisDecodedOperand* operands,
+  uint64_t current_address
+) const {
+  if (is_call(instruction)) {
+    const auto target = get_jump_target(instruction, operands, current_address);
+    if (target && *target >= base_address_ && *target < base_address_ + size_) {
+      function.call_targets.push_back(*target);
+    }
+    return;
+  }
+  if (is_control_flow(instruction)) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < instruction.operand_count; ++i) {
+    const auto& operand = operands[i];
+    if (operand.visibility == ZYDIS_OPERAND_VISIBILITY_HIDDEN) {
+      continue;
+    }
+
+    std::optional<uint64_t> address;
+    if (operand.type == ZYDIS_OPERAND_TYPE_MEMORY) {
+      const auto displacement = static_cast<uint64_t>(operand.mem.disp.value);
+      if (operand.mem.base == ZYDIS_REGISTER_RIP || operand.mem.base == ZYDIS_REGISTER_EIP) {
+        address = current_address + instruction.length + displacement;
+      } else if (operand.mem.base == ZYDIS_REGISTER_NONE && operand.mem.index == ZYDIS_REGISTER_NONE) {
+        address = displacement;
+      }
+    } else if (operand.type == ZYDIS_OPERAND_TYPE_IMMEDIATE && !operand.imm.is_relative) {
+      address = operand.imm.value.u;
+    }
+
+    if (address && is_image_address(*address, address_ranges_)) {
+      function.data_refs.push_back(*address);
+    } else if (operand.type == ZYDIS_OPERAND_TYPE_IMMEDIATE && address && is_distinctive_constant(*address)) {
+      function.constants.push_back(*address);
+    }
+  }
+}
+
+void subroutine_analyzer::finish_references(subroutine& function) {
+  std::ranges::sort(function.call_targets);
+  function.call_targets.erase(std::ranges::unique(function.call_targets).begin(), function.call_targets.end());
+  std::ranges::sort(function.data_refs);
+  function.data_refs.erase(std::ranges::unique(function.data_refs).begin(), function.data_refs.end());
+  std::ranges::sort(function.constants);
+  function.constants.erase(std::ranges::unique(function.constants).begin(), function.constants.end());
 }
 
 std::optional<uint64_t> subroutine_analyzer::get_jump_target(
@@ -610,3 +1072,14 @@ subroutine_analyzer::levenshtein_distance(const std::vector<uint64_t>& seq1, con
 
   return previous[n];
 }
+
+// lanes 12-15 count out degrees, instruction classes fill lanes 0-7 while decoding
+void subroutine_analyzer::add_block_features(feature_vector& features, std::span<const basic_block> blocks) {
+  for (const auto& block : blocks) {
+    const auto size_class = std::ranges::count_if(size_lane_limits, [&](size_t limit) {
+      return block.instruction_keys.size() > limit;
+    });
+    add_feature(features, size_lane + static_cast<size_t>(size_class));
+    add_feature(features, 12 + std::min<size_t>(block.successor_keys.size(), 3));
+  }
+}
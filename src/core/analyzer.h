@@ -2,18 +2,28 @@
 
 #include "decoder.h"
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <optional>
 #include <span>
 #include <stop_token>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 using fingerprint = size_t;
 
 class subroutine_analyzer {
   public:
+  // instruction class histogram, block size distribution and out degree counts
+  static constexpr size_t feature_size = 16;
+  using feature_vector = std::array<uint16_t, feature_size>;
+  // lanes from size_lane on count blocks of at most the matching limit instructions, the last lane takes the rest
+  static constexpr size_t size_lane = 8;
+  static constexpr std::array<size_t, 3> size_lane_limits{2, 5, 10};
+
   struct address_range {
     uint64_t start;
     uint64_t end;
@@ -27,6 +37,8 @@ class subroutine_analyzer {
     std::vector<uint64_t> instruction_keys;
     std::vector<uint64_t> match_keys;
     uint64_t match_hash{14695981039346656037ull};
+
+    [[nodiscard]] auto operator==(const basic_block&) const -> bool = default;
   };
 
   struct subroutine {
@@ -37,6 +49,31 @@ class subroutine_analyzer {
     size_t byte_size{0};
     size_t instruction_count{0};
     uint64_t instruction_hash{0};
+    // weisfeiler-lehman hash of the block graph, independent of block layout
+    uint64_t graph_hash{0};
+    // relocation insensitive hash of the known start range, zero unless reuse is enabled
+    uint64_t range_hash{0};
+    uint64_t byte_hash{0};
+    // minhash over match key trigrams, empty for subroutines without instructions
+    std::vector<uint32_t> sketch;
+    // sorted direct call targets inside the text section
+    std::vector<uint64_t> call_targets;
+    // sorted image addresses read through rip relative or absolute operands
+    std::vector<uint64_t> data_refs;
+    // sorted immediates that are neither addresses nor small values, masks or powers of two
+    std::vector<uint64_t> constants;
+    feature_vector features{};
+
+    [[nodiscard]] auto operator==(const subroutine&) const -> bool = default;
+  };
+
+  static constexpr size_t sketch_size = 32;
+
+  enum class visit_order : uint8_t {
+    // start address order, subroutines that finish early wait for the ones before them
+    address,
+    // whichever worker finishes first
+    completion,
   };
 
   subroutine_analyzer(const uint8_t* data, size_t size, uint64_t base_address);
@@ -59,12 +96,48 @@ class subroutine_analyzer {
   );
 
   std::vector<subroutine> get_subroutines();
+  // hands each subroutine to visit as soon as it is analyzed instead of collecting them, visit is never called
+  // concurrently. discovered starts are always visited in address order
+  void visit_subroutines(const std::function<void(subroutine&&)>& visit, visit_order order = visit_order::address);
+  // one subroutine per known start range carrying only its bounds, nothing is decoded
+  std::vector<subroutine> known_ranges() const;
+  // known_ranges plus range hashes, skipped starts are left out
+  std::vector<subroutine> hash_ranges();
+  // known starts that get_subroutines leaves out, they still bound the ranges around them
+  void skip_starts(std::span<const uint64_t> starts);
+  // called with every subroutine get_subroutines or visit_subroutines finishes, from the analysis workers when there
+  // are several
+  void observe(std::function<void(const subroutine&)> observer);
+  // hash known start ranges and copy any range that hashes equal from prior instead of analyzing it again.
+  // prior must outlive get_subroutines, an empty prior only records the hashes. when prior_ranges equal this
+  // analyzer's address ranges, ranges whose raw bytes are unchanged at the same address are copied without decoding
+  void reuse_from(std::span<const subroutine> prior, std::span<const address_range> prior_ranges = {});
 
   static std::size_t levenshtein_distance(const std::vector<uint64_t>& seq1, const std::vector<uint64_t>& seq2);
+  // adds the block size and out degree lanes of blocks to features
+  static void add_block_features(feature_vector& features, std::span<const basic_block> blocks);
 
   private:
-  std::vector<basic_block> find_basic_blocks(uint64_t start_address, std::optional<uint64_t> end_address_hint);
+  struct prior_index {
+    std::unordered_map<uint64_t, const subroutine*> by_range_hash;
+    // only filled when the prior shares this analyzer's address ranges
+    std::unordered_map<uint64_t, const subroutine*> by_start;
+  };
+
+  void find_basic_blocks(subroutine& function, std::optional<uint64_t> end_address_hint);
+  void record_references(
+    subroutine& function, const ZydisDecodedInstruction& instruction, const ZydisDecodedOperand* operands,
+    uint64_t current_address
+  ) const;
+  static void finish_references(subroutine& function);
+  std::optional<subroutine> analyze_known_start(subroutine_analyzer& analyzer, size_t index);
   subroutine analyze_subroutine(uint64_t start_address, std::optional<uint64_t> end_address_hint);
+  subroutine
+  analyze_range(uint64_t start_address, std::optional<uint64_t> end_address_hint, const prior_index& prior);
+  uint64_t hash_bytes(uint64_t start_address, uint64_t end_address) const;
+  uint64_t hash_range(uint64_t start_address, uint64_t end_address);
+  void redecode(subroutine& function, bool render, bool references);
+  void for_each_known_start(const std::function<void(subroutine_analyzer&, size_t)>& visit);
   void set_byte_size(subroutine& function);
   void check_stop() const;
   std::vector<uint64_t> discover_subroutine_starts();
@@ -77,8 +150,12 @@ class subroutine_analyzer {
   size_t size_;
   uint64_t base_address_;
   std::vector<uint64_t> known_starts_;
+  std::vector<uint64_t> skipped_starts_;
   std::vector<address_range> address_ranges_;
   bool include_instructions_{true};
+  bool reuse_{false};
+  prior_index prior_;
+  std::function<void(const subroutine&)> observer_;
   size_t worker_count_{1};
   std::stop_token stop_token_;
   std::stop_token worker_token_;
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+class buffer_writer {
+  public:
+  template <typename T>
+    requires std::is_trivially_copyable_v<T>
+  void write(const T& value) {
+    const auto* ptr = reinterpret_cast<const uint8_t*>(&value);
+    buffer_.insert(buffer_.end(), ptr, ptr + sizeof(T));
+  }
+
+  void write_string(std::string_view str) {
+    write(static_cast<uint32_t>(str.size()));
+    const auto* ptr = reinterpret_cast<const uint8_t*>(str.data());
+    buffer_.insert(buffer_.end(), ptr, ptr + str.size());
+  }
+
+  // little endian base 128, small values take a single byte
+  void write_varint(uint64_t value) {
+    while (value >= 0x80) {
+      buffer_.push_back(static_cast<uint8_t>(value | 0x80));
+      value >>= 7;
+    }
+    buffer_.push_back(static_cast<uint8_t>(value));
+  }
+
+  // zigzag keeps small negative values as short as small positive ones
+  void write_signed(int64_t value) {
+    write_varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+  }
+
+  template <typename T>
+    requires std::is_trivially_copyable_v<T>
+  void write_span(std::span<const T> values) {
+    const auto* ptr = reinterpret_cast<const uint8_t*>(values.data());
+    buffer_.insert(buffer_.end(), ptr, ptr + values.size_bytes());
+  }
+
+  // zero fill up to the next multiple of alignment
+  void align(size_t alignment) {
+    buffer_.resize((buffer_.size() + alignment - 1) / alignment * alignment);
+  }
+
+  [[nodiscard]] auto size() const -> size_t {
+    return buffer_.size();
+  }
+
+  [[nodiscard]] auto data() const -> std::span<const uint8_t> {
+    return buffer_;
+  }
+
+  void clear() {
+    buffer_.clear();
+  }
+
+  [[nodiscard]] auto save_to_file(const std::string& filepath) const -> bool {
+    std::ofstream os(filepath, std::ios::binary);
+    if (!os) {
+      return false;
+    }
+    os.write(reinterpret_cast<const char*>(buffer_.data()), static_cast<std::streamsize>(buffer_.size()));
+    return os.good();
+  }
+
+  private:
+  std::vector<uint8_t> buffer_;
+};
+
+class buffer_reader {
+  public:
+  explicit buffer_reader(std::span<const uint8_t> data) : data_(data) {
+  }
+
+  template <typename T>
+    requires std::is_trivially_copyable_v<T>
+  [[nodiscard]] auto read() -> std::optional<T> {
+    if (sizeof(T) > data_.size() - offset_) {
+      return std::nullopt;
+    }
+    T value;
+    std::memcpy(&value, data_.data() + offset_, sizeof(T));
+    offset_ += sizeof(T);
+    return value;
+  }
+
+  [[nodiscard]] auto read_varint() -> std::optional<uint64_t> {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      if (offset_ >= data_.size()) {
+        return std::nullopt;
+      }
+      const auto byte = data_[offset_++];
+      value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        return value;
+      }
+    }
+    return std::nullopt;
+  }
+
+  [[nodiscard]] auto read_signed() -> std::optional<int64_t> {
+    const auto value = read_varint();
+    if (!value) {
+      return std::nullopt;
+    }
+    return static_cast<int64_t>((*value >> 1) ^ (~(*value & 1) + 1));
+  }
+
+  // borrows the bytes instead of copying them
+  [[nodiscard]] auto read_bytes(size_t size) -> std::optional<std::span<const uint8_t>> {
+    if (size > data_.size() - offset_) {
+      return std::nullopt;
+    }
+    const auto bytes = data_.subspan(offset_, size);
+    offset_ += size;
+    return bytes;
+  }
+
+  [[nodiscard]] auto remaining() const -> size_t {
+    return data_.size() - offset_;
+  }
+
+  [[nodiscard]] auto read_string() -> std::optional<std::string> {
+    auto len = read<uint32_t>();
+    if (!len || *len > data_.size() - offset_) {
+      return std::nullopt;
+    }
+    std::string str(reinterpret_cast<const char*>(data_.data() + offset_), *len);
+    offset_ += *len;
+    return str;
+  }
+
+  private:
+  std::span<const uint8_t> data_;
+  size_t offset_{0};
+};
+
+[[nodiscard]] inline auto read_file(const std::string& filepath) -> std::optional<std::vector<uint8_t>> {
+  std::ifstream is(filepath, std::ios::binary | std::ios::ate);
+  if (!is) {
+    return std::nullopt;
+  }
+
+  const auto size = is.tellg();
+  if (size < 0) {
+    return std::nullopt;
+  }
+
+  is.seekg(0, std::ios::beg);
+  std::vector<uint8_t> buffer(static_cast<size_t>(size));
+  if (!is.read(reinterpret_cast<char*>(buffer.data()), size)) {
+    return std::nullopt;
+  }
+  return buffer;
+}
@@ -0,0 +1,189 @@
+#include "cache.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <random>
+#include <system_error>
+#include <utility>
+#include "buffer.h"
+#include "codec.h"
+
+namespace {
+
+  constexpr uint32_t snapshot_magic = 0x5a594153; // zyas
+  constexpr uint32_t snapshot_version = 11;
+
+  constexpr uint64_t fnv_offset = 14695981039346656037ull;
+  constexpr uint64_t fnv_prime = 1099511628211ull;
+
+  void hash_word(uint64_t& hash, uint64_t value) {
+    hash ^= value;
+    hash *= fnv_prime;
+    hash ^= hash >> 29;
+  }
+
+  // full 64x64 bit product with its halves xored together, built from 32 bit halves so it needs no compiler
+  // extension
+  [[nodiscard]] auto fold_multiply(uint64_t lhs, uint64_t rhs) -> uint64_t {
+    const auto low_low = (lhs & 0xffffffff) * (rhs & 0xffffffff);
+    const auto low_high = (lhs & 0xffffffff) * (rhs >> 32);
+    const auto high_low = (lhs >> 32) * (rhs & 0xffffffff);
+    const auto high_high = (lhs >> 32) * (rhs >> 32);
+    const auto cross = (low_low >> 32) + (low_high & 0xffffffff) + high_low;
+    const auto low = (cross << 32) | (low_low & 0xffffffff);
+    const auto high = high_high + (low_high >> 32) + (cross >> 32);
+    return low ^ high;
+  }
+
+  // 128 bit digest in two lanes of multiply folding over 16 byte blocks, text sections can be hundreds of megabytes
+  // so the file is only read once
+  [[nodiscard]] auto digest_bytes(std::span<const uint8_t> data) -> std::array<uint64_t, 2> {
+    constexpr std::array<uint64_t, 4> secrets{
+      0xa0761d6478bd642f, 0xe7037ed1a0b428db, 0x8ebc6af09c88c6e3, 0x589965cc75374cc3
+    };
+    auto read_word = [&](size_t offset) {
+      uint64_t word{};
+      std::memcpy(&word, data.data() + offset, std::min(sizeof(word), data.size() - offset));
+      return word;
+    };
+
+    std::array<uint64_t, 2> lanes{secrets[0] ^ data.size(), secrets[1] ^ data.size()};
+    for (size_t offset = 0; offset < data.size(); offset += 2 * sizeof(uint64_t)) {
+      const auto first = read_word(offset);
+      const auto second = offset + sizeof(uint64_t) < data.size() ? read_word(offset + sizeof(uint64_t)) : 0;
+      lanes[0] = fold_multiply(first ^ secrets[2], second ^ lanes[0]);
+      lanes[1] = fold_multiply(second ^ secrets[3], first ^ lanes[1]);
+    }
+    return {
+      fold_multiply(lanes[0] ^ secrets[1], lanes[1] ^ secrets[2]),
+      fold_multiply(lanes[1], lanes[0] ^ secrets[3]),
+    };
+  }
+
+} // namespace
+
+analysis_cache::analysis_cache(std::string directory) : directory_(std::move(directory)) {
+}
+
+auto analysis_cache::make_key(
+  std::span<const uint8_t> text, uint64_t base_address, std::span<const uint64_t> known_starts,
+  std::span<const subroutine_analyzer::address_range> address_ranges, bool include_instructions, bool range_hashes
+) -> key {
+  uint64_t options_hash = fnv_offset;
+  hash_word(options_hash, snapshot_version);
+  hash_word(options_hash, base_address);
+  hash_word(options_hash, include_instructions);
+  hash_word(options_hash, range_hashes);
+  hash_word(options_hash, known_starts.size());
+  for (const auto start : known_starts) {
+    hash_word(options_hash, start);
+  }
+  hash_word(options_hash, address_ranges.size());
+  for (const auto& range : address_ranges) {
+    hash_word(options_hash, range.start);
+    hash_word(options_hash, range.end);
+  }
+
+  const auto digest = digest_bytes(text);
+  return {
+    .content_hash = digest[0] ^ digest[1],
+    .options_hash = options_hash,
+    .text_size = text.size(),
+    .text_digest = digest,
+  };
+}
+
+auto analysis_cache::load(const key& key) const -> std::optional<std::vector<subroutine_analyzer::subroutine>> {
+  const auto buffer = read_file(snapshot_path(key));
+  if (!buffer) {
+    return std::nullopt;
+  }
+
+  buffer_reader br(*buffer);
+  const auto magic = br.read<uint32_t>();
+  const auto version = br.read<uint32_t>();
+  const auto content_hash = br.read<uint64_t>();
+  const auto options_hash = br.read<uint64_t>();
+  const auto text_size = br.read<uint64_t>();
+  const auto text_digest = br.read<std::array<uint64_t, 2>>();
+  const auto count = br.read<uint64_t>();
+  if (
+    !magic || *magic != snapshot_magic || !version || *version != snapshot_version || !content_hash || !options_hash
+  ) {
+    return std::nullopt;
+  }
+  if (!text_size || !text_digest || !count) {
+    return std::nullopt;
+  }
+  const analysis_cache::key stored{
+    .content_hash = *content_hash,
+    .options_hash = *options_hash,
+    .text_size = *text_size,
+    .text_digest = *text_digest,
+  };
+  if (key != stored) {
+    return std::nullopt;
+  }
+
+  const auto dict = subroutine_codec::dictionary::read(br);
+  if (!dict) {
+    return std::nullopt;
+  }
+
+  std::vector<subroutine_analyzer::subroutine> subroutines;
+  subroutines.reserve(static_cast<size_t>(std::min<uint64_t>(*count, buffer->size())));
+  for (uint64_t i = 0; i < *count; ++i) {
+    auto sub = subroutine_codec::read(br, *dict);
+    if (!sub) {
+      return std::nullopt;
+    }
+    subroutines.push_back(std::move(*sub));
+  }
+  return subroutines;
+}
+
+auto analysis_cache::store(const key& key, const std::vector<subroutine_analyzer::subroutine>& subroutines) const
+  -> bool {
+  std::error_code error;
+  std::filesystem::create_directories(directory_, error);
+  if (error) {
+    return false;
+  }
+
+  subroutine_codec::dictionary_builder dict;
+  buffer_writer records;
+  for (const auto& sub : subroutines) {
+    subroutine_codec::write(records, sub, dict);
+  }
+
+  buffer_writer bw;
+  bw.write(snapshot_magic);
+  bw.write(snapshot_version);
+  bw.write(key.content_hash);
+  bw.write(key.options_hash);
+  bw.write(key.text_size);
+  bw.write(key.text_digest);
+  bw.write(static_cast<uint64_t>(subroutines.size()));
+  dict.write(bw);
+  bw.write_span(records.data());
+
+  // write beside the snapshot and rename so concurrent runs never read a partial file
+  const auto path = snapshot_path(key);
+  const auto temporary_path = std::format("{}.{:08x}.tmp", path, std::random_device{}());
+  if (!bw.save_to_file(temporary_path)) {
+    std::filesystem::remove(temporary_path, error);
+    return false;
+  }
+  std::filesystem::rename(temporary_path, path, error);
+  if (error) {
+    std::filesystem::remove(temporary_path, error);
+    return false;
+  }
+  return true;
+}
+
+auto analysis_cache::snapshot_path(const key& key) const -> std::string {
+  return (std::filesystem::path(directory_) / std::format("{:016x}{:016x}.zya", key.content_hash, key.options_hash))
+    .string();
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+#include "analyzer.h"
+
+// on-disk snapshots of subroutine_analyzer output, keyed by text content and analysis options
+class analysis_cache {
+  public:
+  // the two hashes name the snapshot file, the text size and digest stored inside it are checked on load so a hash
+  // collision or a snapshot copied from another binary is never trusted
+  struct key {
+    uint64_t content_hash{};
+    uint64_t options_hash{};
+    uint64_t text_size{};
+    std::array<uint64_t, 2> text_digest{};
+
+    [[nodiscard]] auto operator==(const key&) const -> bool = default;
+  };
+
+  explicit analysis_cache(std::string directory);
+
+  [[nodiscard]] static auto make_key(
+    std::span<const uint8_t> text, uint64_t base_address, std::span<const uint64_t> known_starts,
+    std::span<const subroutine_analyzer::address_range> address_ranges, bool include_instructions, bool range_hashes
+  ) -> key;
+
+  [[nodiscard]] auto load(const key& key) const -> std::optional<std::vector<subroutine_analyzer::subroutine>>;
+  [[nodiscard]] auto store(const key& key, const std::vector<subroutine_analyzer::subroutine>& subroutines) const
+    -> bool;
+
+  private:
+  [[nodiscard]] auto snapshot_path(const key& key) const -> std::string;
+
+  std::string directory_;
+};
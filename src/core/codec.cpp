@@ -0,0 +1,349 @@
+#include "codec.h"
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace {
+
+  // every encoded element takes at least a byte, so larger counts can only come from a corrupt file
+  [[nodiscard]] auto read_count(buffer_reader& br) -> std::optional<size_t> {
+    const auto count = br.read_varint();
+    if (!count || *count > br.remaining()) {
+      return std::nullopt;
+    }
+    return static_cast<size_t>(*count);
+  }
+
+  // sorted lists become gaps from origin and then from each previous value, wrapping keeps any order lossless
+  void write_sorted(buffer_writer& bw, const std::vector<uint64_t>& values, uint64_t origin) {
+    bw.write_varint(values.size());
+    auto previous = origin;
+    for (const auto value : values) {
+      bw.write_signed(static_cast<int64_t>(value - previous));
+      previous = value;
+    }
+  }
+
+  [[nodiscard]] auto read_sorted(buffer_reader& br, uint64_t origin) -> std::optional<std::vector<uint64_t>> {
+    const auto count = read_count(br);
+    if (!count) {
+      return std::nullopt;
+    }
+    std::vector<uint64_t> values;
+    values.reserve(*count);
+    auto previous = origin;
+    for (size_t i = 0; i < *count; ++i) {
+      const auto delta = br.read_signed();
+      if (!delta) {
+        return std::nullopt;
+      }
+      previous += static_cast<uint64_t>(*delta);
+      values.push_back(previous);
+    }
+    return values;
+  }
+
+  void write_keys(buffer_writer& bw, const std::vector<uint64_t>& keys, subroutine_codec::dictionary_builder& dict) {
+    bw.write_varint(keys.size());
+    for (const auto key : keys) {
+      bw.write_varint(dict.key(key));
+    }
+  }
+
+  [[nodiscard]] auto read_keys(buffer_reader& br, const subroutine_codec::dictionary& dict)
+    -> std::optional<std::vector<uint64_t>> {
+    const auto count = read_count(br);
+    if (!count) {
+      return std::nullopt;
+    }
+    std::vector<uint64_t> keys;
+    keys.reserve(*count);
+    for (size_t i = 0; i < *count; ++i) {
+      const auto index = br.read_varint();
+      const auto key = index ? dict.key(*index) : std::nullopt;
+      if (!key) {
+        return std::nullopt;
+      }
+      keys.push_back(*key);
+    }
+    return keys;
+  }
+
+  // block starts are relative to the end of the block before them, so address ordered blocks cost a byte
+  void write_basic_block(
+    buffer_writer& bw, const subroutine_analyzer::basic_block& bb, uint64_t previous_end,
+    subroutine_codec::dictionary_builder& dict
+  ) {
+    bw.write_signed(static_cast<int64_t>(bb.start_address - previous_end));
+    bw.write_signed(static_cast<int64_t>(bb.end_address - bb.start_address));
+
+    bw.write_varint(bb.successor_keys.size());
+    for (const auto key : bb.successor_keys) {
+      bw.write_signed(key);
+    }
+
+    write_keys(bw, bb.instruction_keys, dict);
+    write_keys(bw, bb.match_keys, dict);
+    bw.write(bb.match_hash);
+
+    bw.write_varint(bb.instructions.size());
+    for (const auto& instr : bb.instructions) {
+      bw.write_varint(dict.text(instr));
+    }
+  }
+
+  auto read_basic_block(buffer_reader& br, uint64_t previous_end, const subroutine_codec::dictionary& dict)
+    -> std::expected<subroutine_analyzer::basic_block, std::string> {
+    subroutine_analyzer::basic_block bb;
+
+    auto start = br.read_signed();
+    auto length = br.read_signed();
+    if (!start || !length) {
+      return std::unexpected("corrupt basic_block header");
+    }
+
+    bb.start_address = previous_end + static_cast<uint64_t>(*start);
+    bb.end_address = bb.start_address + static_cast<uint64_t>(*length);
+
+    auto successor_count = read_count(br);
+    if (!successor_count) {
+      return std::unexpected("corrupt basic_block successor keys");
+    }
+    bb.successor_keys.reserve(*successor_count);
+    for (size_t i = 0; i < *successor_count; ++i) {
+      auto key = br.read_signed();
+      if (!key) {
+        return std::unexpected("corrupt basic_block successor key");
+      }
+      bb.successor_keys.push_back(*key);
+    }
+
+    auto instruction_keys = read_keys(br, dict);
+    if (!instruction_keys) {
+      return std::unexpected("corrupt basic_block instruction keys");
+    }
+    bb.instruction_keys = std::move(*instruction_keys);
+    auto match_keys = read_keys(br, dict);
+    if (!match_keys) {
+      return std::unexpected("corrupt basic_block match keys");
+    }
+    bb.match_keys = std::move(*match_keys);
+    auto match_hash = br.read<uint64_t>();
+    if (!match_hash) {
+      return std::unexpected("corrupt basic_block match hash");
+    }
+    bb.match_hash = *match_hash;
+
+    auto inst_count = read_count(br);
+    if (!inst_count) {
+      return std::unexpected("corrupt basic_block instruction count");
+    }
+
+    bb.instructions.reserve(*inst_count);
+    for (size_t i = 0; i < *inst_count; ++i) {
+      auto index = br.read_varint();
+      auto inst = index ? dict.text(*index) : std::nullopt;
+      if (!inst) {
+        return std::unexpected("corrupt basic_block instruction");
+      }
+      bb.instructions.emplace_back(*inst);
+    }
+
+    return bb;
+  }
+
+} // namespace
+
+auto subroutine_codec::dictionary_builder::key(uint64_t value) -> uint64_t {
+  auto [it, inserted] = key_ids_.try_emplace(value, keys_.size());
+  if (inserted) {
+    keys_.push_back(value);
+  }
+  return it->second;
+}
+
+auto subroutine_codec::dictionary_builder::text(const std::string& value) -> uint64_t {
+  // map nodes never move, so the order list can point at their keys
+  auto [it, inserted] = text_ids_.try_emplace(value, texts_.size());
+  if (inserted) {
+    texts_.push_back(&it->first);
+  }
+  return it->second;
+}
+
+void subroutine_codec::dictionary_builder::write(buffer_writer& bw) const {
+  bw.write_varint(keys_.size());
+  bw.write_span(std::span<const uint64_t>(keys_));
+
+  bw.write_varint(texts_.size());
+  uint64_t offset = 0;
+  for (const auto* text : texts_) {
+    bw.write(offset);
+    offset += text->size();
+  }
+  bw.write(offset);
+  for (const auto* text : texts_) {
+    bw.write_span(std::span<const char>(*text));
+  }
+}
+
+auto subroutine_codec::dictionary::read(buffer_reader& br) -> std::expected<dictionary, std::string> {
+  dictionary dict;
+  const auto key_count = br.read_varint();
+  if (!key_count || *key_count > br.remaining() / sizeof(uint64_t)) {
+    return std::unexpected("corrupt dictionary keys");
+  }
+  dict.keys_ = *br.read_bytes(static_cast<size_t>(*key_count) * sizeof(uint64_t));
+
+  const auto text_count = br.read_varint();
+  if (!text_count || *text_count >= br.remaining() / sizeof(uint64_t)) {
+    return std::unexpected("corrupt dictionary text");
+  }
+  dict.text_offsets_ = *br.read_bytes((static_cast<size_t>(*text_count) + 1) * sizeof(uint64_t));
+
+  uint64_t text_size{};
+  std::memcpy(&text_size, &*(dict.text_offsets_.end() - sizeof(text_size)), sizeof(text_size));
+  if (text_size > br.remaining()) {
+    return std::unexpected("corrupt dictionary text");
+  }
+  dict.text_ = *br.read_bytes(static_cast<size_t>(text_size));
+  return dict;
+}
+
+auto subroutine_codec::dictionary::key(uint64_t index) const -> std::optional<uint64_t> {
+  if (index >= keys_.size() / sizeof(uint64_t)) {
+    return std::nullopt;
+  }
+  uint64_t value{};
+  std::memcpy(&value, keys_.data() + index * sizeof(uint64_t), sizeof(value));
+  return value;
+}
+
+auto subroutine_codec::dictionary::text(uint64_t index) const -> std::optional<std::string_view> {
+  if (index + 1 >= text_offsets_.size() / sizeof(uint64_t)) {
+    return std::nullopt;
+  }
+  uint64_t begin{};
+  uint64_t end{};
+  std::memcpy(&begin, text_offsets_.data() + index * sizeof(uint64_t), sizeof(begin));
+  std::memcpy(&end, text_offsets_.data() + (index + 1) * sizeof(uint64_t), sizeof(end));
+  if (begin > end || end > text_.size()) {
+    return std::nullopt;
+  }
+  return std::string_view(reinterpret_cast<const char*>(text_.data() + begin), static_cast<size_t>(end - begin));
+}
+
+void subroutine_codec::write(buffer_writer& bw, const subroutine_analyzer::subroutine& sub, dictionary_builder& dict) {
+  bw.write_varint(sub.start_address);
+  bw.write_signed(static_cast<int64_t>(sub.end_address - sub.start_address));
+  bw.write(static_cast<uint64_t>(sub.fingerprint));
+  bw.write_varint(sub.byte_size);
+  bw.write_varint(sub.instruction_count);
+  bw.write(sub.instruction_hash);
+  bw.write(sub.graph_hash);
+  bw.write(sub.range_hash);
+  bw.write(sub.byte_hash);
+  bw.write_varint(sub.sketch.size());
+  for (const auto value : sub.sketch) {
+    bw.write(value);
+  }
+  write_sorted(bw, sub.call_targets, sub.start_address);
+  write_sorted(bw, sub.data_refs, sub.start_address);
+  write_sorted(bw, sub.constants, 0);
+  for (const auto count : sub.features) {
+    bw.write_varint(count);
+  }
+
+  bw.write_varint(sub.basic_blocks.size());
+  auto previous_end = sub.start_address;
+  for (const auto& bb : sub.basic_blocks) {
+    write_basic_block(bw, bb, previous_end, dict);
+    previous_end = bb.end_address;
+  }
+}
+
+auto subroutine_codec::read(buffer_reader& br, const dictionary& dict)
+  -> std::expected<subroutine_analyzer::subroutine, std::string> {
+  subroutine_analyzer::subroutine sub;
+
+  auto start = br.read_varint();
+  auto length = br.read_signed();
+  auto fp = br.read<uint64_t>();
+  auto byte_size = br.read_varint();
+  auto instruction_count = br.read_varint();
+  auto instruction_hash = br.read<uint64_t>();
+  auto graph_hash = br.read<uint64_t>();
+  auto range_hash = br.read<uint64_t>();
+  auto byte_hash = br.read<uint64_t>();
+  auto sketch_count = read_count(br);
+
+  if (
+    !start || !length || !fp || !byte_size || !instruction_count || !instruction_hash || !graph_hash || !range_hash ||
+    !byte_hash || !sketch_count
+  ) {
+    return std::unexpected("corrupt subroutine header");
+  }
+
+  sub.sketch.reserve(*sketch_count);
+  for (size_t i = 0; i < *sketch_count; ++i) {
+    auto value = br.read<uint32_t>();
+    if (!value) {
+      return std::unexpected("corrupt subroutine sketch");
+    }
+    sub.sketch.push_back(*value);
+  }
+
+  auto call_targets = read_sorted(br, *start);
+  if (!call_targets) {
+    return std::unexpected("corrupt subroutine call targets");
+  }
+  sub.call_targets = std::move(*call_targets);
+
+  auto data_refs = read_sorted(br, *start);
+  if (!data_refs) {
+    return std::unexpected("corrupt subroutine data references");
+  }
+  sub.data_refs = std::move(*data_refs);
+
+  auto constants = read_sorted(br, 0);
+  if (!constants) {
+    return std::unexpected("corrupt subroutine constants");
+  }
+  sub.constants = std::move(*constants);
+
+  for (auto& count : sub.features) {
+    auto value = br.read_varint();
+    if (!value || *value > std::numeric_limits<uint16_t>::max()) {
+      return std::unexpected("corrupt subroutine features");
+    }
+    count = static_cast<uint16_t>(*value);
+  }
+
+  auto bb_count = read_count(br);
+  if (!bb_count) {
+    return std::unexpected("corrupt subroutine block count");
+  }
+
+  sub.start_address = *start;
+  sub.end_address = *start + static_cast<uint64_t>(*length);
+  sub.fingerprint = static_cast<fingerprint>(*fp);
+  sub.byte_size = static_cast<size_t>(*byte_size);
+  sub.instruction_count = static_cast<size_t>(*instruction_count);
+  sub.instruction_hash = *instruction_hash;
+  sub.graph_hash = *graph_hash;
+  sub.range_hash = *range_hash;
+  sub.byte_hash = *byte_hash;
+
+  sub.basic_blocks.reserve(*bb_count);
+  auto previous_end = sub.start_address;
+  for (size_t i = 0; i < *bb_count; ++i) {
+    auto bb = read_basic_block(br, previous_end, dict);
+    if (!bb) {
+      return std::unexpected(bb.error());
+    }
+    previous_end = bb->end_address;
+    sub.basic_blocks.push_back(std::move(*bb));
+  }
+
+  return sub;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "analyzer.h"
+#include "buffer.h"
+
+// binary encoding of analyzed subroutines shared by the diff and analysis snapshot formats. addresses are delta
+// encoded varints, and instruction keys, match keys and instruction text are indices into a per file dictionary
+class subroutine_codec {
+  public:
+  // interns keys and instruction text while records are written, ids follow first use
+  class dictionary_builder {
+    public:
+    [[nodiscard]] auto key(uint64_t value) -> uint64_t;
+    [[nodiscard]] auto text(const std::string& value) -> uint64_t;
+    void write(buffer_writer& bw) const;
+
+    private:
+    std::vector<uint64_t> keys_;
+    std::unordered_map<uint64_t, uint64_t> key_ids_;
+    std::vector<const std::string*> texts_;
+    std::unordered_map<std::string, uint64_t> text_ids_;
+  };
+
+  // random access over a dictionary read back from a file, borrows the reader's bytes
+  class dictionary {
+    public:
+    [[nodiscard]] static auto read(buffer_reader& br) -> std::expected<dictionary, std::string>;
+    [[nodiscard]] auto key(uint64_t index) const -> std::optional<uint64_t>;
+    [[nodiscard]] auto text(uint64_t index) const -> std::optional<std::string_view>;
+
+    private:
+    std::span<const uint8_t> keys_;
+    // one more offset than texts, each text ends where the next begins
+    std::span<const uint8_t> text_offsets_;
+    std::span<const uint8_t> text_;
+  };
+
+  static void write(buffer_writer& bw, const subroutine_analyzer::subroutine& sub, dictionary_builder& dict);
+  [[nodiscard]] static auto read(buffer_reader& br, const dictionary& dict)
+    -> std::expected<subroutine_analyzer::subroutine, std::string>;
+};
@@ -1,5 +1,6 @@
 #include "differ.h"
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <cmath>
 #include <future>
@@ -12,10 +13,13 @@
 #include <stdexcept>
 #include <stop_token>
 #include <thread>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
+#include "cache.h"
+#include "vptree.h"
 
 namespace {
 
@@ -66,28 +70,33 @@ namespace {
     return ranges;
   }
 
-  struct match_key {
-    fingerprint code_fingerprint{};
-    size_t instruction_count{};
-
-    [[nodiscard]] auto operator==(const match_key&) const -> bool = default;
-  };
-
-  struct match_key_hash {
-    [[nodiscard]] auto operator()(const match_key& key) const -> size_t {
-      auto hash = static_cast<uint64_t>(key.code_fingerprint);
-      hash ^= static_cast<uint64_t>(key.instruction_count) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
-      return static_cast<size_t>(hash);
+  // pairs ranges with equal range hashes in address order, like the exact buckets below
+  std::vector<std::pair<size_t, size_t>> pair_ranges(
+    std::span<const subroutine_analyzer::subroutine> primary, std::span<const subroutine_analyzer::subroutine> secondary
+  ) {
+    std::unordered_map<uint64_t, std::vector<size_t>> secondary_hashes;
+    for (size_t i = 0; i < secondary.size(); ++i) {
+      secondary_hashes[secondary[i].range_hash].push_back(i);
     }
-  };
 
-  [[nodiscard]] auto make_key(const subroutine_analyzer::subroutine& sub) -> match_key {
-    return match_key{
-      .code_fingerprint = sub.fingerprint,
-      .instruction_count = sub.instruction_count,
-    };
+    std::unordered_map<uint64_t, size_t> hash_indices;
+    std::vector<std::pair<size_t, size_t>> pairs;
+    for (size_t i = 0; i < primary.size(); ++i) {
+      const auto hash_it = secondary_hashes.find(primary[i].range_hash);
+      if (hash_it == secondary_hashes.end()) {
+        continue;
+      }
+      auto& hash_index = hash_indices[primary[i].range_hash];
+      if (hash_index < hash_it->second.size()) {
+        pairs.emplace_back(i, hash_it->second[hash_index++]);
+      }
+    }
+    return pairs;
   }
 
+  // bounds are summed in a different order than the scores they bound, so they only prune clear of the threshold
+  constexpr double bound_slack = 1e-9;
+
   double block_upper_bound(
     const subroutine_analyzer::basic_block& primary, const subroutine_analyzer::basic_block& secondary
   ) {
@@ -257,8 +266,277 @@ namespace {
                                 : binary_differ::change_type::values_changed;
   }
 
+  constexpr size_t sketch_rows = 2;
+  constexpr size_t sketch_bands = subroutine_analyzer::sketch_size / sketch_rows;
+
+  [[nodiscard]] auto has_sketch(const subroutine_analyzer::subroutine& sub) -> bool {
+    return sub.sketch.size() == subroutine_analyzer::sketch_size;
+  }
+
+  [[nodiscard]] auto band_hash(const subroutine_analyzer::subroutine& sub, size_t band) -> uint64_t {
+    auto hash = static_cast<uint64_t>(band);
+    for (size_t i = band * sketch_rows; i < (band + 1) * sketch_rows; ++i) {
+      hash ^= static_cast<uint64_t>(sub.sketch[i]) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+    }
+    return hash;
+  }
+
+  // equal sketch slots estimate the jaccard similarity of the key trigram sets
+  [[nodiscard]] auto sketch_overlap(
+    const subroutine_analyzer::subroutine& primary, const subroutine_analyzer::subroutine& secondary
+  ) -> size_t {
+    if (!has_sketch(primary) || !has_sketch(secondary)) {
+      return 0;
+    }
+    size_t overlap = 0;
+    for (size_t i = 0; i < subroutine_analyzer::sketch_size; ++i) {
+      overlap += primary.sketch[i] == secondary.sketch[i] ? 1 : 0;
+    }
+    return overlap;
+  }
+
+  constexpr size_t embedding_size = 36;
+  using embedding = std::array<float, embedding_size>;
+
+  // key trigram buckets describe what the code does, the log scaled counters its shape and call degree
+  [[nodiscard]] auto make_embedding(const subroutine_analyzer::subroutine& sub) -> embedding {
+    constexpr size_t gram_buckets = 16;
+    constexpr float counter_scale = 0.25f;
+    embedding values{};
+    for (const auto& block : sub.basic_blocks) {
+      const auto& keys = block.match_keys;
+      const auto count = keys.size() < 3 ? std::min<size_t>(keys.size(), 1) : keys.size() - 2;
+      for (size_t i = 0; i < count; ++i) {
+        auto gram = keys[i];
+        for (size_t j = i + 1; j < std::min(i + 3, keys.size()); ++j) {
+          gram ^= keys[j] + 0x9e3779b97f4a7c15ull + (gram << 6) + (gram >> 2);
+        }
+        values[gram % gram_buckets] += 1.0f;
+      }
+    }
+    float norm = 0.0f;
+    for (size_t i = 0; i < gram_buckets; ++i) {
+      norm += values[i] * values[i];
+    }
+    if (norm > 0.0f) {
+      norm = std::sqrt(norm);
+      for (size_t i = 0; i < gram_buckets; ++i) {
+        values[i] /= norm;
+      }
+    }
+
+    auto counter = [&](size_t value) {
+      return std::log1p(static_cast<float>(value)) * counter_scale;
+    };
+    for (size_t i = 0; i < subroutine_analyzer::feature_size; ++i) {
+      values[gram_buckets + i] = counter(sub.features[i]);
+    }
+    values[32] = counter(sub.call_targets.size());
+    values[33] = counter(sub.data_refs.size());
+    values[34] = counter(sub.instruction_count);
+    values[35] = counter(sub.basic_blocks.size());
+    return values;
+  }
+
+  // strings hash their text up to the terminator, other data hashes its leading bytes. code and zero fill have no
+  // content worth anchoring on
+  [[nodiscard]] auto reference_content_key(const binary_parser& parser, uint64_t address) -> std::optional<uint64_t> {
+    constexpr size_t min_string_length = 4;
+    constexpr size_t data_length = 16;
+    const auto* text = parser.get_text_section();
+    for (const auto& section : parser.get_sections()) {
+      const auto start = parser.get_image_base() + section.virtual_address;
+      if (
+        &section == text || section.virtual_address == 0 || address < start || address - start >= section.data.size()
+      ) {
+        continue;
+      }
+
+      const auto bytes = std::span(section.data).subspan(static_cast<size_t>(address - start));
+      uint64_t hash = 14695981039346656037ull;
+      auto add_byte = [&](uint8_t value) {
+        hash ^= value;
+        hash *= 1099511628211ull;
+      };
+      const auto string_end = std::ranges::find_if(bytes, [](uint8_t value) {
+        return value != '\t' && (value < 0x20 || value > 0x7e);
+      });
+      const auto string_length = static_cast<size_t>(string_end - bytes.begin());
+      if (string_length >= min_string_length && string_end != bytes.end() && *string_end == 0) {
+        add_byte('s');
+        std::ranges::for_each(bytes.first(string_length), add_byte);
+        return hash;
+      }
+
+      const auto data = bytes.first(std::min(data_length, bytes.size()));
+      const auto zero_fill = std::ranges::all_of(data, [](uint8_t value) {
+        return value == 0;
+      });
+      if (zero_fill) {
+        return std::nullopt;
+      }
+      add_byte('d');
+      std::ranges::for_each(data, add_byte);
+      return hash;
+    }
+    return std::nullopt;
+  }
+
+  // keys held by exactly one subroutine on each side pair those two subroutines
+  template <typename primary_keys_of, typename secondary_keys_of>
+  [[nodiscard]] auto unique_key_pairs(
+    size_t primary_count, size_t secondary_count, const primary_keys_of& primary_keys,
+    const secondary_keys_of& secondary_keys
+  ) -> std::vector<std::pair<size_t, size_t>> {
+    constexpr auto shared = std::numeric_limits<size_t>::max();
+    auto index_keys = [](size_t count, const auto& keys_of) {
+      std::unordered_map<uint64_t, size_t> owners;
+      for (size_t i = 0; i < count; ++i) {
+        for (const auto key : keys_of(i)) {
+          auto [it, inserted] = owners.try_emplace(key, i);
+          if (!inserted && it->second != i) {
+            it->second = shared;
+          }
+        }
+      }
+      return owners;
+    };
+    const auto primary_owners = index_keys(primary_count, primary_keys);
+    const auto secondary_owners = index_keys(secondary_count, secondary_keys);
+
+    std::vector<std::pair<size_t, size_t>> pairs;
+    for (const auto& [key, primary_index] : primary_owners) {
+      const auto it = secondary_owners.find(key);
+      if (primary_index != shared && it != secondary_owners.end() && it->second != shared) {
+        pairs.emplace_back(primary_index, it->second);
+      }
+    }
+    std::ranges::sort(pairs);
+    pairs.erase(std::ranges::unique(pairs).begin(), pairs.end());
+    return pairs;
+  }
+
+  struct call_graph {
+    std::vector<std::vector<size_t>> callees;
+    std::vector<std::vector<size_t>> callers;
+  };
+
+  // edges between subroutine indices, calls into the middle of a subroutine are dropped
+  [[nodiscard]] auto make_call_graph(std::span<const subroutine_analyzer::subroutine> subroutines) -> call_graph {
+    call_graph graph;
+    graph.callees.resize(subroutines.size());
+    graph.callers.resize(subroutines.size());
+    for (size_t i = 0; i < subroutines.size(); ++i) {
+      for (const auto target : subroutines[i].call_targets) {
+        const auto it = std::ranges::lower_bound(subroutines, target, {}, [](const auto& sub) {
+          return sub.start_address;
+        });
+        if (it == subroutines.end() || it->start_address != target) {
+          continue;
+        }
+        const auto callee = static_cast<size_t>(it - subroutines.begin());
+        graph.callees[i].push_back(callee);
+        graph.callers[callee].push_back(i);
+      }
+    }
+    return graph;
+  }
+
+  // the region covering [start, end) entirely, regions are ordered by primary address
+  [[nodiscard]] auto containing_region(std::span<const text_regions::region> regions, uint64_t start, uint64_t end)
+    -> const text_regions::region* {
+    const auto it = std::ranges::upper_bound(regions, start, {}, [](const auto& region) {
+      return region.primary_address;
+    });
+    if (it == regions.begin()) {
+      return nullptr;
+    }
+    const auto& region = *std::prev(it);
+    return end <= region.primary_address + region.size ? &region : nullptr;
+  }
+
+  // known start ranges inside an identical region are byte identical to the range at the region's shift
+  [[nodiscard]] auto pair_region_ranges(
+    std::span<const subroutine_analyzer::subroutine> primary,
+    std::span<const subroutine_analyzer::subroutine> secondary, std::span<const text_regions::region> regions
+  ) -> std::vector<std::pair<size_t, size_t>> {
+    std::vector<std::pair<size_t, size_t>> pairs;
+    for (size_t i = 0; i < primary.size(); ++i) {
+      const auto* region = containing_region(regions, primary[i].start_address, primary[i].end_address);
+      if (!region) {
+        continue;
+      }
+      const auto address = primary[i].start_address + (region->secondary_address - region->primary_address);
+      const auto it = std::ranges::lower_bound(secondary, address, {}, [](const auto& range) {
+        return range.start_address;
+      });
+      if (it != secondary.end() && it->start_address == address && it->byte_size == primary[i].byte_size) {
+        pairs.emplace_back(i, static_cast<size_t>(it - secondary.begin()));
+      }
+    }
+    return pairs;
+  }
+
+  // pairs exact bucket members while both analyses are still running. a key is only paired while each side has
+  // published one subroutine for it, crowded buckets are left to the address ordered pairing after the barrier
+  class exact_pipeline {
+    public:
+    using pair_callback =
+      std::function<void(const subroutine_analyzer::subroutine&, const subroutine_analyzer::subroutine&)>;
+
+    explicit exact_pipeline(pair_callback on_pair) : on_pair_(std::move(on_pair)) {}
+
+    // thread safe, the subroutine only has to live for the duration of the call
+    void publish(const subroutine_analyzer::subroutine& sub, bool primary) {
+      auto key = static_cast<uint64_t>(sub.fingerprint);
+      key ^= static_cast<uint64_t>(sub.instruction_count) + 0x9e3779b97f4a7c15ull + (key << 6) + (key >> 2);
+      key ^= sub.instruction_hash + 0x9e3779b97f4a7c15ull + (key << 6) + (key >> 2);
+
+      const auto side = primary ? 0 : 1;
+      std::unique_ptr<const subroutine_analyzer::subroutine> partner;
+      {
+        const std::scoped_lock lock(mutex_);
+        auto& slot = slots_[key];
+        if (slot.published[side]++ != 0) {
+          slot.waiting.reset();
+          return;
+        }
+        if (slot.published[1 - side] == 0) {
+          slot.waiting = std::make_unique<const subroutine_analyzer::subroutine>(sub);
+          return;
+        }
+        partner = std::move(slot.waiting);
+      }
+      if (!partner) {
+        return;
+      }
+      if (primary) {
+        on_pair_(sub, *partner);
+      } else {
+        on_pair_(*partner, sub);
+      }
+    }
+
+    private:
+    struct slot {
+      std::array<size_t, 2> published{};
+      // copy of the first subroutine until its partner arrives
+      std::unique_ptr<const subroutine_analyzer::subroutine> waiting;
+    };
+
+    pair_callback on_pair_;
+    std::mutex mutex_;
+    std::unordered_map<uint64_t, slot> slots_;
+  };
+
 } // namespace
 
+auto binary_differ::match_key_hash::operator()(const match_key& key) const -> size_t {
+  auto hash = static_cast<uint64_t>(key.code_fingerprint);
+  hash ^= static_cast<uint64_t>(key.instruction_count) + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+  return static_cast<size_t>(hash);
+}
+
 binary_differ::binary_differ(const std::string& primary_path, const std::string& secondary_path) :
     binary_differ(primary_path, secondary_path, compare_options{}) {
 }
@@ -270,9 +548,126 @@ binary_differ::binary_differ(
     secondary_(std::make_unique<binary_parser>(secondary_path)), options_(options) {
 }
 
+binary_differ::binary_differ(const std::string& primary_path, compare_options options) :
+    primary_(std::make_unique<binary_parser>(primary_path)), options_(options) {
+}
+
+size_t binary_differ::worker_count() const {
+  return options_.worker_count == 0 ? std::max(1u, std::thread::hardware_concurrency()) : options_.worker_count;
+}
+
+subroutine_analyzer
+binary_differ::make_analyzer(const binary_parser& parser, size_t worker_count, std::stop_token stop_token) const {
+  const auto* text = parser.get_text_section();
+  if (!text) {
+    throw std::runtime_error("failed to find text sections");
+  }
+
+  const auto ranges = get_ranges(parser);
+  return subroutine_analyzer(
+    text->data.data(), text->data.size(), parser.get_image_base() + text->virtual_address,
+    parser.get_function_starts(), options_.include_instructions, worker_count, stop_token, ranges
+  );
+}
+
+binary_differ::analysis binary_differ::analyze(
+  const binary_parser& parser, size_t worker_count, std::stop_token stop_token,
+  std::span<const subroutine_analyzer::subroutine> prior, std::vector<subroutine_analyzer::subroutine> identical,
+  std::function<void(const subroutine_analyzer::subroutine&)> observer
+) const {
+  auto analyzer = make_analyzer(parser, worker_count, stop_token);
+  analyzer.observe(std::move(observer));
+
+  // snapshots only hold complete analyses, so ranges paired ahead of time bypass the cache
+  analysis result;
+  std::optional<analysis_cache> cache;
+  analysis_cache::key cache_key;
+  if (!options_.cache_directory.empty() && identical.empty()) {
+    const auto* text = parser.get_text_section();
+    cache.emplace(options_.cache_directory);
+    cache_key = analysis_cache::make_key(
+      text->data, parser.get_image_base() + text->virtual_address, parser.get_function_starts(), get_ranges(parser),
+      options_.include_instructions, options_.incremental
+    );
+  }
+  auto cached = cache ? cache->load(cache_key) : std::nullopt;
+
+  if (cached) {
+    result.subroutines = std::move(*cached);
+  } else {
+    if (options_.incremental) {
+      // a prior always comes from the primary
+      analyzer.reuse_from(prior, get_ranges(*primary_));
+    }
+    std::vector<uint64_t> identical_starts;
+    identical_starts.reserve(identical.size());
+    for (const auto& sub : identical) {
+      identical_starts.push_back(sub.start_address);
+    }
+    analyzer.skip_starts(identical_starts);
+
+    result.subroutines = analyzer.get_subroutines();
+    result.subroutines.insert(
+      result.subroutines.end(), std::make_move_iterator(identical.begin()), std::make_move_iterator(identical.end())
+    );
+    std::ranges::stable_sort(result.subroutines, [](const auto& lhs, const auto& rhs) {
+      return lhs.start_address < rhs.start_address;
+    });
+    if (cache) {
+      // a failed store only costs the next run a fresh analysis
+      (void)cache->store(cache_key, result.subroutines);
+    }
+  }
+  for (size_t i = 0; i < result.subroutines.size(); ++i) {
+    const auto& sub = result.subroutines[i];
+    result.buckets[{.code_fingerprint = sub.fingerprint, .instruction_count = sub.instruction_count}].push_back(i);
+    result.graph_buckets[sub.graph_hash].push_back(i);
+  }
+
+  std::unordered_map<uint64_t, std::optional<uint64_t>> content_keys;
+  result.reference_keys.resize(result.subroutines.size());
+  for (size_t i = 0; i < result.subroutines.size(); ++i) {
+    for (const auto address : result.subroutines[i].data_refs) {
+      auto [it, inserted] = content_keys.try_emplace(address);
+      if (inserted) {
+        it->second = reference_content_key(parser, address);
+      }
+      if (it->second) {
+        result.reference_keys[i].push_back(*it->second);
+      }
+    }
+  }
+  return result;
+}
+
+const binary_differ::analysis& binary_differ::primary_analysis() {
+  if (!primary_analysis_) {
+    primary_analysis_ = analyze(*primary_, worker_count(), {}, {}, {});
+  }
+  return *primary_analysis_;
+}
+
+std::vector<text_regions::region>
+binary_differ::find_regions(const binary_parser& primary, const binary_parser& secondary) const {
+  const auto* primary_text = primary.get_text_section();
+  const auto* secondary_text = secondary.get_text_section();
+  if (options_.region_min_length == 0 || !primary_text || !secondary_text) {
+    return {};
+  }
+  return text_regions::find(
+    primary_text->data, primary.get_image_base() + primary_text->virtual_address, secondary_text->data,
+    secondary.get_image_base() + secondary_text->virtual_address, {.min_length = options_.region_min_length}
+  );
+}
+
 binary_differ::diff_result binary_differ::compare() {
-  diff_result result;
-  skipped_candidates_ = 0;
+  return compare(result_sink{});
+}
+
+binary_differ::diff_result binary_differ::compare(const result_sink& sink) {
+  if (!secondary_) {
+    throw std::runtime_error("no secondary binary to compare against");
+  }
 
   auto primary_text = primary_->get_text_section();
   auto secondary_text = secondary_->get_text_section();
@@ -281,34 +676,103 @@ binary_differ::diff_result binary_differ::compare() {
     throw std::runtime_error("failed to find text sections");
   }
 
-  const auto analysis_workers = std::max(1u, std::thread::hardware_concurrency() / 2);
-  const auto primary_ranges = get_ranges(*primary_);
-  const auto secondary_ranges = get_ranges(*secondary_);
+  const auto workers = worker_count();
+  match_hints hints;
+  hints.regions = find_regions(*primary_, *secondary_);
+
+  std::vector<subroutine_analyzer::subroutine> primary_identical;
+  std::vector<subroutine_analyzer::subroutine> secondary_identical;
+  if (
+    options_.skip_identical && !primary_->get_function_starts().empty() &&
+    !secondary_->get_function_starts().empty()
+  ) {
+    auto primary_analyzer = make_analyzer(*primary_, workers, {});
+    auto secondary_analyzer = make_analyzer(*secondary_, workers, {});
+
+    // ranges inside an identical region pair up without being decoded
+    auto primary_ranges = primary_analyzer.known_ranges();
+    auto secondary_ranges = secondary_analyzer.known_ranges();
+    std::vector<uint64_t> primary_paired;
+    std::vector<uint64_t> secondary_paired;
+    for (const auto& [primary_index, secondary_index] :
+         pair_region_ranges(primary_ranges, secondary_ranges, hints.regions)) {
+      primary_paired.push_back(primary_ranges[primary_index].start_address);
+      secondary_paired.push_back(secondary_ranges[secondary_index].start_address);
+      primary_identical.push_back(std::move(primary_ranges[primary_index]));
+      secondary_identical.push_back(std::move(secondary_ranges[secondary_index]));
+    }
+    primary_analyzer.skip_starts(primary_paired);
+    secondary_analyzer.skip_starts(secondary_paired);
+
+    auto primary_hashed = primary_analyzer.hash_ranges();
+    auto secondary_hashed = secondary_analyzer.hash_ranges();
+    for (const auto& [primary_index, secondary_index] : pair_ranges(primary_hashed, secondary_hashed)) {
+      primary_identical.push_back(std::move(primary_hashed[primary_index]));
+      secondary_identical.push_back(std::move(secondary_hashed[secondary_index]));
+    }
+  }
+
+  std::vector<std::pair<uint64_t, uint64_t>> identical_pairs;
+  identical_pairs.reserve(primary_identical.size());
+  for (size_t i = 0; i < primary_identical.size(); ++i) {
+    identical_pairs.emplace_back(primary_identical[i].start_address, secondary_identical[i].start_address);
+  }
+  auto diff_identical = [&](analysis& primary, analysis& secondary) {
+    auto index_of = [](const analysis& analysis, uint64_t address) {
+      const auto it = std::ranges::lower_bound(analysis.subroutines, address, {}, [](const auto& sub) {
+        return sub.start_address;
+      });
+      return static_cast<size_t>(it - analysis.subroutines.begin());
+    };
+    hints.prematched.reserve(identical_pairs.size());
+    for (const auto& [primary_address, secondary_address] : identical_pairs) {
+      hints.prematched.push_back({
+        .primary_index = index_of(primary, primary_address),
+        .secondary_index = index_of(secondary, secondary_address),
+        .similarity = 1.0,
+      });
+    }
+    return diff(std::move(primary), std::move(secondary), hints, sink);
+  };
+
+  if (options_.incremental && !secondary_->get_function_starts().empty()) {
+    // the secondary copies unchanged ranges from the primary, so it has to wait for it
+    auto primary = analyze(*primary_, workers, {}, {}, std::move(primary_identical));
+    auto secondary = analyze(*secondary_, workers, {}, primary.subroutines, std::move(secondary_identical));
+    return diff_identical(primary, secondary);
+  }
+
+  const auto analysis_workers = std::max(size_t{1}, worker_count() / 2);
   std::stop_source analysis_stop;
   const auto analysis_token = analysis_stop.get_token();
 
+  // exact pairs are scored by whichever analysis worker completes them, matching itself waits for both analyses
+  std::mutex prescored_mutex;
+  exact_pipeline pipeline([&](const auto& primary_sub, const auto& secondary_sub) {
+    const auto scored = prescore(primary_sub, secondary_sub);
+    const std::scoped_lock lock(prescored_mutex);
+    hints.prescored.emplace(primary_sub.start_address, scored);
+  });
+  auto publish_primary = [&](const subroutine_analyzer::subroutine& sub) {
+    pipeline.publish(sub, true);
+  };
+  auto publish_secondary = [&](const subroutine_analyzer::subroutine& sub) {
+    pipeline.publish(sub, false);
+  };
+
   auto primary_future = std::async(std::launch::async, [&, analysis_token] {
     try {
-      subroutine_analyzer analyzer(
-        primary_text->data.data(), primary_text->data.size(),
-        primary_->get_image_base() + primary_text->virtual_address, primary_->get_function_starts(),
-        options_.include_instructions, analysis_workers, analysis_token, primary_ranges
-      );
-      return analyzer.get_subroutines();
+      return analyze(*primary_, analysis_workers, analysis_token, {}, std::move(primary_identical), publish_primary);
     } catch (...) {
       analysis_stop.request_stop();
       throw;
     }
   });
 
-  std::vector<subroutine_analyzer::subroutine> secondary_subroutines;
+  analysis secondary;
   try {
-    subroutine_analyzer secondary_analyzer(
-      secondary_text->data.data(), secondary_text->data.size(),
-      secondary_->get_image_base() + secondary_text->virtual_address, secondary_->get_function_starts(),
-      options_.include_instructions, analysis_workers, analysis_token, secondary_ranges
-    );
-    secondary_subroutines = secondary_analyzer.get_subroutines();
+    secondary =
+      analyze(*secondary_, analysis_workers, analysis_token, {}, std::move(secondary_identical), publish_secondary);
   } catch (...) {
     const bool primary_failed = analysis_stop.stop_requested();
     const auto failure = std::current_exception();
@@ -322,47 +786,155 @@ binary_differ::diff_result binary_differ::compare() {
     }
     std::rethrow_exception(failure);
   }
-  auto primary_subroutines = primary_future.get();
+  auto primary = primary_future.get();
+  return diff_identical(primary, secondary);
+}
+
+binary_differ::diff_result binary_differ::compare(const std::string& secondary_path) {
+  const binary_parser secondary_parser(secondary_path);
+  const auto& primary = primary_analysis();
+  auto secondary =
+    analyze(secondary_parser, worker_count(), {}, primary.subroutines, {});
+  return diff(primary, std::move(secondary), {.regions = find_regions(*primary_, secondary_parser)}, {});
+}
+
+std::vector<binary_differ::diff_result>
+binary_differ::compare(std::span<const std::string> secondary_paths, size_t concurrency) {
+  const auto& primary = primary_analysis();
+  std::vector<diff_result> results(secondary_paths.size());
+
+  const auto thread_count = std::min(std::max(size_t{1}, concurrency), secondary_paths.size());
+  const auto analysis_workers =
+    std::max<size_t>(1, worker_count() / std::max(size_t{1}, thread_count));
+  std::atomic_size_t next_index{0};
+  std::stop_source stop_source;
+  std::exception_ptr failure;
+  std::mutex failure_mutex;
+  {
+    std::vector<std::jthread> workers;
+    workers.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+      workers.emplace_back([&] {
+        try {
+          while (!stop_source.stop_requested()) {
+            const auto index = next_index.fetch_add(1, std::memory_order_relaxed);
+            if (index >= secondary_paths.size()) {
+              break;
+            }
+            const binary_parser secondary_parser(secondary_paths[index]);
+            auto secondary =
+              analyze(secondary_parser, analysis_workers, stop_source.get_token(), primary.subroutines, {});
+            auto regions = find_regions(*primary_, secondary_parser);
+            results[index] = diff(primary, std::move(secondary), {.regions = std::move(regions)}, {});
+          }
+        } catch (...) {
+          stop_source.request_stop();
+          const std::scoped_lock lock(failure_mutex);
+          if (!failure) {
+            failure = std::current_exception();
+          }
+        }
+      });
+    }
+  }
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+  return results;
+}
+
+// a const primary is shared with other diffs, so its subroutines are copied instead of moved
+template <typename primary_analysis_type>
+binary_differ::diff_result binary_differ::diff_analyses(
+  primary_analysis_type& primary, analysis& secondary, const match_hints& hints, const result_sink& sink
+) const {
+  constexpr bool keep_primary = std::is_const_v<primary_analysis_type>;
+  auto take_primary = [&](size_t index) -> subroutine_analyzer::subroutine {
+    if constexpr (keep_primary) {
+      return primary.subroutines[index];
+    } else {
+      return std::move(primary.subroutines[index]);
+    }
+  };
+  auto& primary_subroutines = primary.subroutines;
+  auto& secondary_subroutines = secondary.subroutines;
+
+  diff_result result;
   result.primary_count = primary_subroutines.size();
   result.secondary_count = secondary_subroutines.size();
 
-  auto matches = match_subroutines(primary_subroutines, secondary_subroutines);
-  result.skipped_candidates = skipped_candidates_;
+  auto matches = match_subroutines(primary, secondary, hints, result.skipped_candidates, result.prefiltered_candidates);
 
+  // every record is moved into a local first, so whatever a sink does not keep is freed before the next one
   std::vector<bool> matched_primary(primary_subroutines.size());
   std::vector<bool> matched_secondary(secondary_subroutines.size());
-  result.matches.reserve(matches.size());
+  if (!sink.match) {
+    result.matches.reserve(matches.size());
+  }
   for (auto& match : matches) {
     const auto change = classify_change(
       primary_subroutines[match.primary_index], secondary_subroutines[match.secondary_index], match.similarity
     );
-    result.matches.push_back({
-      .primary = std::move(primary_subroutines[match.primary_index]),
+    matched_subroutine matched{
+      .primary = take_primary(match.primary_index),
       .secondary = std::move(secondary_subroutines[match.secondary_index]),
       .change = change,
       .similarity = match.similarity,
-    });
+    };
+    if (sink.match) {
+      sink.match(std::move(matched));
+    } else {
+      result.matches.push_back(std::move(matched));
+    }
     matched_primary[match.primary_index] = true;
     matched_secondary[match.secondary_index] = true;
   }
 
-  result.unmatched_primary.reserve(primary_subroutines.size() - matches.size());
+  if (!sink.unmatched_primary) {
+    result.unmatched_primary.reserve(primary_subroutines.size() - matches.size());
+  }
   for (size_t i = 0; i < primary_subroutines.size(); ++i) {
-    if (!matched_primary[i]) {
-      result.unmatched_primary.push_back(std::move(primary_subroutines[i]));
+    if (matched_primary[i]) {
+      continue;
+    }
+    auto sub = take_primary(i);
+    if (sink.unmatched_primary) {
+      sink.unmatched_primary(std::move(sub));
+    } else {
+      result.unmatched_primary.push_back(std::move(sub));
     }
   }
 
-  result.unmatched_secondary.reserve(secondary_subroutines.size() - matches.size());
+  if (!sink.unmatched_secondary) {
+    result.unmatched_secondary.reserve(secondary_subroutines.size() - matches.size());
+  }
   for (size_t i = 0; i < secondary_subroutines.size(); ++i) {
-    if (!matched_secondary[i]) {
-      result.unmatched_secondary.push_back(std::move(secondary_subroutines[i]));
+    if (matched_secondary[i]) {
+      continue;
+    }
+    auto sub = std::move(secondary_subroutines[i]);
+    if (sink.unmatched_secondary) {
+      sink.unmatched_secondary(std::move(sub));
+    } else {
+      result.unmatched_secondary.push_back(std::move(sub));
     }
   }
 
   return result;
 }
 
+binary_differ::diff_result binary_differ::diff(
+  const analysis& primary, analysis&& secondary, const match_hints& hints, const result_sink& sink
+) const {
+  return diff_analyses(primary, secondary, hints, sink);
+}
+
+binary_differ::diff_result binary_differ::diff(
+  analysis&& primary, analysis&& secondary, const match_hints& hints, const result_sink& sink
+) const {
+  return diff_analyses(primary, secondary, hints, sink);
+}
+
 std::vector<binary_differ::block_match> binary_differ::match_blocks(
   const subroutine_analyzer::subroutine& primary, const subroutine_analyzer::subroutine& secondary
 ) {
@@ -555,19 +1127,74 @@ binary_differ::diff_blocks(const matched_subroutine& match) {
   return diff_blocks(match.primary, match.secondary);
 }
 
-double
-binary_differ::score_subroutines(const subroutine_analyzer::subroutine& s1, const subroutine_analyzer::subroutine& s2) {
-  double total_similarity = 0.0;
+binary_differ::prescored_pair binary_differ::prescore(
+  const subroutine_analyzer::subroutine& primary, const subroutine_analyzer::subroutine& secondary
+) const {
+  prescored_pair scored{.secondary_address = secondary.start_address, .similarity = 1.0};
+  if (blocks_equal(primary, secondary)) {
+    return scored;
+  }
+  scored.similarity = score_subroutines(primary, secondary, options_.match_threshold);
+  return scored;
+}
+
+double binary_differ::score_bound(
+  const subroutine_analyzer::subroutine& s1, const subroutine_analyzer::subroutine& s2
+) {
+  // match_blocks pairs blocks one to one and a pair scores at most its instruction count ratio. that ratio only
+  // reaches 1 inside a size lane, across lanes it stays at or below the largest limit over the count after it.
+  // scores of whole blocks sum exactly, a ratio below 1 may round up so it carries the slack
+  constexpr auto& limits = subroutine_analyzer::size_lane_limits;
+  constexpr double cross_lane_ratio =
+    static_cast<double>(limits.back()) / static_cast<double>(limits.back() + 1) + bound_slack;
+  const auto pair_count = std::min(s1.basic_blocks.size(), s2.basic_blocks.size());
+  const auto max_blocks = static_cast<double>(std::max({size_t{1}, s1.basic_blocks.size(), s2.basic_blocks.size()}));
+
+  size_t primary_blocks = 0;
+  size_t secondary_blocks = 0;
+  size_t same_lane = 0;
+  for (size_t lane = subroutine_analyzer::size_lane; lane <= subroutine_analyzer::size_lane + limits.size(); ++lane) {
+    primary_blocks += s1.features[lane];
+    secondary_blocks += s2.features[lane];
+    same_lane += std::min(s1.features[lane], s2.features[lane]);
+  }
+  // saturated lanes leave only the block count bound
+  if (primary_blocks != s1.basic_blocks.size() || secondary_blocks != s2.basic_blocks.size()) {
+    return static_cast<double>(pair_count) / max_blocks;
+  }
+  return (static_cast<double>(same_lane) + static_cast<double>(pair_count - same_lane) * cross_lane_ratio) / max_blocks;
+}
+
+double binary_differ::score_subroutines(
+  const subroutine_analyzer::subroutine& s1, const subroutine_analyzer::subroutine& s2, double threshold
+) {
   const auto block_matches = match_blocks(s1, s2);
   const auto block_map = make_block_map(s1.basic_blocks.size(), block_matches);
+  const auto max_blocks = static_cast<double>(std::max({size_t{1}, s1.basic_blocks.size(), s2.basic_blocks.size()}));
+
+  // a block scores at most its instruction count ratio, so the bound only shrinks as blocks are scored
+  double remaining_bound = 0.0;
+  for (const auto& match : block_matches) {
+    const auto& bb1 = s1.basic_blocks[match.primary_index];
+    const auto& bb2 = s2.basic_blocks[match.secondary_index];
+    remaining_bound += bb1.instruction_keys.empty() && bb2.instruction_keys.empty() ? 1.0 : block_upper_bound(bb1, bb2);
+  }
+
+  double total_similarity = 0.0;
   for (const auto& match : block_matches) {
+    if ((total_similarity + remaining_bound) / max_blocks + bound_slack <= threshold) {
+      return (total_similarity + remaining_bound) / max_blocks;
+    }
+
     const auto& bb1 = s1.basic_blocks[match.primary_index];
     const auto& bb2 = s2.basic_blocks[match.secondary_index];
     const auto same_flow = has_same_flow(s1, s2, std::span(&match, 1), block_map);
     if (bb1.instruction_keys.empty() && bb2.instruction_keys.empty()) {
+      remaining_bound -= 1.0;
       total_similarity += same_flow ? 1.0 : 0.9;
       continue;
     }
+    remaining_bound -= block_upper_bound(bb1, bb2);
 
     const auto distance = block_distance(bb1, bb2);
     const auto maximum_instructions = std::max({size_t{1}, bb1.instruction_keys.size(), bb2.instruction_keys.size()});
@@ -578,23 +1205,15 @@ binary_differ::score_subroutines(const subroutine_analyzer::subroutine& s1, cons
     total_similarity += std::max(0.0, block_similarity);
   }
 
-  const auto max_blocks = std::max({size_t{1}, s1.basic_blocks.size(), s2.basic_blocks.size()});
-  return total_similarity / static_cast<double>(max_blocks);
+  return total_similarity / max_blocks;
 }
 
 std::vector<binary_differ::match_index> binary_differ::match_subroutines(
-  const std::vector<subroutine_analyzer::subroutine>& primary_subroutines,
-  const std::vector<subroutine_analyzer::subroutine>& secondary_subroutines
-) {
-  std::unordered_map<match_key, std::vector<const subroutine_analyzer::subroutine*>, match_key_hash> primary_map;
-  for (const auto& sub : primary_subroutines) {
-    primary_map[make_key(sub)].push_back(&sub);
-  }
-
-  std::unordered_map<match_key, std::vector<const subroutine_analyzer::subroutine*>, match_key_hash> secondary_map;
-  for (const auto& sub : secondary_subroutines) {
-    secondary_map[make_key(sub)].push_back(&sub);
-  }
+  const analysis& primary, const analysis& secondary, const match_hints& hints, size_t& skipped_candidates,
+  size_t& prefiltered_candidates
+) const {
+  const auto& primary_subroutines = primary.subroutines;
+  const auto& secondary_subroutines = secondary.subroutines;
 
   struct match_candidate {
     double similarity;
@@ -631,53 +1250,103 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
     return lhs_secondary < rhs_secondary;
   };
 
+  // pairs whose score bound cannot clear the threshold are counted instead of scored
+  std::atomic_size_t prefiltered{0};
+  auto prefilter = [&](const subroutine_analyzer::subroutine& primary_sub,
+                       const subroutine_analyzer::subroutine& secondary_sub, double threshold) {
+    if (score_bound(primary_sub, secondary_sub) <= threshold) {
+      prefiltered.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    return true;
+  };
+
   std::vector<match_index> matches;
   matches.reserve(std::min(primary_subroutines.size(), secondary_subroutines.size()));
-  std::set<uint64_t> matched_primary_addrs;
-  std::set<uint64_t> matched_secondary_addrs;
+  // dense bitsets indexed like the subroutine vectors
+  std::vector<bool> matched_primary(primary_subroutines.size());
+  std::vector<bool> matched_secondary(secondary_subroutines.size());
+  auto primary_matched = [&](const subroutine_analyzer::subroutine& sub) -> bool {
+    return matched_primary[static_cast<size_t>(&sub - primary_subroutines.data())];
+  };
+  auto secondary_matched = [&](const subroutine_analyzer::subroutine& sub) -> bool {
+    return matched_secondary[static_cast<size_t>(&sub - secondary_subroutines.data())];
+  };
+  auto add_match = [&](const match_index& match) {
+    matches.push_back(match);
+    matched_primary[match.primary_index] = true;
+    matched_secondary[match.secondary_index] = true;
+  };
 
+  // candidates arrive sorted by sort_candidates, so a greedy pass keeps the best pair for every subroutine. it is
+  // two bit tests per candidate, orders of magnitude below the scoring that produced them, so it stays on one thread
   auto resolve_matches = [&](const std::vector<match_candidate>& candidates) {
     for (const auto& candidate : candidates) {
-      if (
-        matched_primary_addrs.contains(candidate.primary->start_address) ||
-        matched_secondary_addrs.contains(candidate.secondary->start_address)
-      ) {
+      if (primary_matched(*candidate.primary) || secondary_matched(*candidate.secondary)) {
         continue;
       }
-      matches.push_back({
+      add_match({
         .primary_index = static_cast<size_t>(candidate.primary - primary_subroutines.data()),
         .secondary_index = static_cast<size_t>(candidate.secondary - secondary_subroutines.data()),
         .similarity = candidate.similarity,
       });
-      matched_primary_addrs.insert(candidate.primary->start_address);
-      matched_secondary_addrs.insert(candidate.secondary->start_address);
     }
   };
 
-  std::vector<candidate_pair> exact_pairs;
-  exact_pairs.reserve(primary_subroutines.size());
-  for (auto& [key, primary_bucket] : primary_map) {
-    auto secondary_it = secondary_map.find(key);
-    if (secondary_it == secondary_map.end()) {
+  for (const auto& match : hints.prematched) {
+    add_match(match);
+  }
+
+  // a subroutine inside an identical region only needs its twin at the region's shift confirmed
+  for (size_t i = 0; i < primary_subroutines.size() && !hints.regions.empty(); ++i) {
+    const auto& primary_sub = primary_subroutines[i];
+    const auto* region = containing_region(hints.regions, primary_sub.start_address, primary_sub.end_address);
+    if (!region || matched_primary[i]) {
       continue;
     }
-
-    auto& secondary_bucket = secondary_it->second;
-    std::ranges::sort(primary_bucket, [](const auto* lhs, const auto* rhs) {
-      return lhs->start_address < rhs->start_address;
+    const auto address = primary_sub.start_address + (region->secondary_address - region->primary_address);
+    const auto it = std::ranges::lower_bound(secondary_subroutines, address, {}, [](const auto& sub) {
+      return sub.start_address;
     });
-    std::ranges::sort(secondary_bucket, [](const auto* lhs, const auto* rhs) {
-      return lhs->start_address < rhs->start_address;
+    if (
+      it == secondary_subroutines.end() || it->start_address != address || secondary_matched(*it) ||
+      it->byte_size != primary_sub.byte_size || it->instruction_hash != primary_sub.instruction_hash ||
+      it->fingerprint != primary_sub.fingerprint
+    ) {
+      continue;
+    }
+    add_match({
+      .primary_index = i,
+      .secondary_index = static_cast<size_t>(it - secondary_subroutines.begin()),
+      .similarity = 1.0,
     });
+  }
+
+  std::vector<candidate_pair> exact_pairs;
+  exact_pairs.reserve(primary_subroutines.size());
+  for (const auto& [key, primary_bucket] : primary.buckets) {
+    auto secondary_it = secondary.buckets.find(key);
+    if (secondary_it == secondary.buckets.end()) {
+      continue;
+    }
 
+    // buckets are address ordered because the subroutines they index are
+    const auto& secondary_bucket = secondary_it->second;
     std::unordered_map<uint64_t, std::vector<const subroutine_analyzer::subroutine*>> secondary_hashes;
-    for (const auto* secondary_sub : secondary_bucket) {
-      secondary_hashes[secondary_sub->instruction_hash].push_back(secondary_sub);
+    for (const auto secondary_index : secondary_bucket) {
+      const auto* secondary_sub = &secondary_subroutines[secondary_index];
+      if (!secondary_matched(*secondary_sub)) {
+        secondary_hashes[secondary_sub->instruction_hash].push_back(secondary_sub);
+      }
     }
     std::unordered_map<uint64_t, size_t> hash_indices;
     std::set<uint64_t> paired_addresses;
     std::vector<const subroutine_analyzer::subroutine*> remaining_primary;
-    for (const auto* primary_sub : primary_bucket) {
+    for (const auto primary_index : primary_bucket) {
+      const auto* primary_sub = &primary_subroutines[primary_index];
+      if (primary_matched(*primary_sub)) {
+        continue;
+      }
       auto hash_it = secondary_hashes.find(primary_sub->instruction_hash);
       if (hash_it == secondary_hashes.end()) {
         remaining_primary.push_back(primary_sub);
@@ -694,8 +1363,12 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
     }
 
     std::vector<const subroutine_analyzer::subroutine*> remaining_secondary;
-    for (const auto* secondary_sub : secondary_bucket) {
-      if (!paired_addresses.contains(secondary_sub->start_address)) {
+    for (const auto secondary_index : secondary_bucket) {
+      const auto* secondary_sub = &secondary_subroutines[secondary_index];
+      if (
+        !paired_addresses.contains(secondary_sub->start_address) &&
+        !secondary_matched(*secondary_sub)
+      ) {
         remaining_secondary.push_back(secondary_sub);
       }
     }
@@ -705,55 +1378,101 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
     }
   }
 
-  const auto exact_workers = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), exact_pairs.size());
-  std::atomic_size_t exact_index{0};
-  std::stop_source exact_stop;
-  std::exception_ptr exact_failure;
-  std::mutex exact_mutex;
-  std::vector<std::vector<match_candidate>> exact_batches(exact_workers);
-  {
-    std::vector<std::jthread> workers;
-    workers.reserve(exact_workers);
-    for (size_t thread_index = 0; thread_index < exact_workers; ++thread_index) {
-      workers.emplace_back([&, thread_index] {
-        try {
-          auto& output = exact_batches[thread_index];
-          while (!exact_stop.stop_requested()) {
-            const auto index = exact_index.fetch_add(1, std::memory_order_relaxed);
-            if (index >= exact_pairs.size()) {
-              break;
+  // scores pairs whose blocks may already be equal and resolves whatever clears the threshold
+  auto score_pairs = [&](const std::vector<candidate_pair>& pairs, double threshold) {
+    const auto exact_workers = std::min<size_t>(worker_count(), pairs.size());
+    std::atomic_size_t exact_index{0};
+    std::stop_source exact_stop;
+    std::exception_ptr exact_failure;
+    std::mutex exact_mutex;
+    std::vector<std::vector<match_candidate>> exact_batches(exact_workers);
+    {
+      std::vector<std::jthread> workers;
+      workers.reserve(exact_workers);
+      for (size_t thread_index = 0; thread_index < exact_workers; ++thread_index) {
+        workers.emplace_back([&, thread_index] {
+          try {
+            auto& output = exact_batches[thread_index];
+            while (!exact_stop.stop_requested()) {
+              const auto index = exact_index.fetch_add(1, std::memory_order_relaxed);
+              if (index >= pairs.size()) {
+                break;
+              }
+              const auto [primary_sub, secondary_sub] = pairs[index];
+              auto similarity = 1.0;
+              const auto prescored = threshold == options_.match_threshold
+                                       ? hints.prescored.find(primary_sub->start_address)
+                                       : hints.prescored.end();
+              if (
+                prescored != hints.prescored.end() &&
+                prescored->second.secondary_address == secondary_sub->start_address
+              ) {
+                similarity = prescored->second.similarity;
+              } else if (!blocks_equal(*primary_sub, *secondary_sub)) {
+                if (!prefilter(*primary_sub, *secondary_sub, threshold)) {
+                  continue;
+                }
+                similarity = score_subroutines(*primary_sub, *secondary_sub, threshold);
+              }
+              if (similarity > threshold) {
+                output.push_back({.similarity = similarity, .primary = primary_sub, .secondary = secondary_sub});
+              }
             }
-            const auto [primary_sub, secondary_sub] = exact_pairs[index];
-            const auto similarity =
-              blocks_equal(*primary_sub, *secondary_sub) ? 1.0 : score_subroutines(*primary_sub, *secondary_sub);
-            if (similarity > options_.match_threshold) {
-              output.push_back({.similarity = similarity, .primary = primary_sub, .secondary = secondary_sub});
+          } catch (...) {
+            exact_stop.request_stop();
+            const std::scoped_lock lock(exact_mutex);
+            if (!exact_failure) {
+              exact_failure = std::current_exception();
             }
           }
-        } catch (...) {
-          exact_stop.request_stop();
-          const std::scoped_lock lock(exact_mutex);
-          if (!exact_failure) {
-            exact_failure = std::current_exception();
-          }
-        }
-      });
+        });
+      }
+    }
+    if (exact_failure) {
+      std::rethrow_exception(exact_failure);
     }
-  }
-  if (exact_failure) {
-    std::rethrow_exception(exact_failure);
-  }
 
-  std::vector<match_candidate> exact_matches;
-  exact_matches.reserve(exact_pairs.size());
-  for (auto& batch : exact_batches) {
-    exact_matches.insert(
-      exact_matches.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end())
-    );
-  }
+    std::vector<match_candidate> exact_matches;
+    exact_matches.reserve(pairs.size());
+    for (auto& batch : exact_batches) {
+      exact_matches.insert(
+        exact_matches.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end())
+      );
+    }
+
+    std::ranges::sort(exact_matches, sort_candidates);
+    resolve_matches(exact_matches);
+  };
+  score_pairs(exact_pairs, options_.match_threshold);
+
+  // reordered blocks change the fingerprint but not the graph hash, so leftovers get a second layout blind bucket
+  std::vector<candidate_pair> graph_pairs;
+  for (const auto& [hash, primary_bucket] : primary.graph_buckets) {
+    auto secondary_it = secondary.graph_buckets.find(hash);
+    if (secondary_it == secondary.graph_buckets.end()) {
+      continue;
+    }
 
-  std::ranges::sort(exact_matches, sort_candidates);
-  resolve_matches(exact_matches);
+    std::vector<const subroutine_analyzer::subroutine*> remaining_primary;
+    for (const auto primary_index : primary_bucket) {
+      const auto* primary_sub = &primary_subroutines[primary_index];
+      if (!primary_sub->basic_blocks.empty() && !primary_matched(*primary_sub)) {
+        remaining_primary.push_back(primary_sub);
+      }
+    }
+    std::vector<const subroutine_analyzer::subroutine*> remaining_secondary;
+    for (const auto secondary_index : secondary_it->second) {
+      const auto* secondary_sub = &secondary_subroutines[secondary_index];
+      if (!secondary_sub->basic_blocks.empty() && !secondary_matched(*secondary_sub)) {
+        remaining_secondary.push_back(secondary_sub);
+      }
+    }
+    const auto remaining_count = std::min(remaining_primary.size(), remaining_secondary.size());
+    for (size_t i = 0; i < remaining_count; ++i) {
+      graph_pairs.emplace_back(remaining_primary[i], remaining_secondary[i]);
+    }
+  }
+  score_pairs(graph_pairs, options_.match_threshold);
 
   std::map<int64_t, size_t> delta_counts;
   for (const auto& match : matches) {
@@ -771,6 +1490,27 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
   });
 
   std::vector<int64_t> address_deltas{0};
+  // identical regions measure their shift directly, the ones covering the most code go first
+  std::map<int64_t, uint64_t> region_coverage;
+  for (const auto& region : hints.regions) {
+    region_coverage[region.delta()] += region.size;
+  }
+  std::vector<std::pair<int64_t, uint64_t>> ranked_regions(region_coverage.begin(), region_coverage.end());
+  std::ranges::sort(ranked_regions, [](const auto& lhs, const auto& rhs) {
+    if (lhs.second != rhs.second) {
+      return lhs.second > rhs.second;
+    }
+    return std::abs(lhs.first) < std::abs(rhs.first);
+  });
+  for (const auto& [delta, coverage] : ranked_regions) {
+    if (options_.delta_limit == 0 || address_deltas.size() >= options_.delta_limit) {
+      break;
+    }
+    if (!std::ranges::contains(address_deltas, delta)) {
+      address_deltas.push_back(delta);
+    }
+  }
+
   // common deltas catch small global shifts after exact matches anchor the map
   for (const auto& [delta, count] : ranked_deltas) {
     if (options_.delta_limit == 0 || address_deltas.size() >= options_.delta_limit) {
@@ -790,13 +1530,13 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
   }
 
   auto anchors = matches;
-  std::ranges::sort(anchors, [&](const auto& lhs, const auto& rhs) {
-    return primary_subroutines[lhs.primary_index].start_address < primary_subroutines[rhs.primary_index].start_address;
+  std::ranges::sort(anchors, [](const auto& lhs, const auto& rhs) {
+    return lhs.primary_index < rhs.primary_index;
   });
 
   std::vector<candidate_pair> address_pairs;
   for (const auto& primary_sub : primary_subroutines) {
-    if (matched_primary_addrs.contains(primary_sub.start_address)) {
+    if (primary_matched(primary_sub)) {
       continue;
     }
 
@@ -833,7 +1573,7 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
       auto secondary_it = secondary_by_address.find(secondary_address);
       if (
         secondary_it == secondary_by_address.end() ||
-        matched_secondary_addrs.contains(secondary_it->second->start_address)
+        secondary_matched(*secondary_it->second)
       ) {
         continue;
       }
@@ -843,7 +1583,7 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
   }
 
   const auto address_workers =
-    std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), address_pairs.size());
+    std::min<size_t>(worker_count(), address_pairs.size());
   std::atomic_size_t address_index{0};
   std::stop_source address_stop;
   std::exception_ptr address_failure;
@@ -862,7 +1602,10 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
               break;
             }
             const auto [primary_sub, secondary_sub] = address_pairs[index];
-            const auto similarity = score_subroutines(*primary_sub, *secondary_sub);
+            if (!prefilter(*primary_sub, *secondary_sub, options_.match_threshold)) {
+              continue;
+            }
+            const auto similarity = score_subroutines(*primary_sub, *secondary_sub, options_.match_threshold);
             if (similarity > options_.match_threshold) {
               output.push_back({.similarity = similarity, .primary = primary_sub, .secondary = secondary_sub});
             }
@@ -892,20 +1635,100 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
   std::ranges::sort(address_matches, sort_candidates);
   resolve_matches(address_matches);
 
+  auto score_anchor_pairs = [&](const std::vector<std::pair<size_t, size_t>>& anchor_pairs) {
+    std::vector<candidate_pair> pairs;
+    for (const auto& [primary_index, secondary_index] : anchor_pairs) {
+      const auto* primary_sub = &primary_subroutines[primary_index];
+      const auto* secondary_sub = &secondary_subroutines[secondary_index];
+      if (
+        !primary_matched(*primary_sub) &&
+        !secondary_matched(*secondary_sub)
+      ) {
+        pairs.emplace_back(primary_sub, secondary_sub);
+      }
+    }
+    score_pairs(pairs, options_.fallback_threshold);
+  };
+
+  // a string or data item only one function references on each side ties those functions together
+  score_anchor_pairs(unique_key_pairs(
+    primary_subroutines.size(), secondary_subroutines.size(),
+    [&](size_t index) -> const std::vector<uint64_t>& {
+      return primary.reference_keys[index];
+    },
+    [&](size_t index) -> const std::vector<uint64_t>& {
+      return secondary.reference_keys[index];
+    }
+  ));
+
+  // magic numbers and error codes survive recompilation, one owner per side is as good as a shared string
+  score_anchor_pairs(unique_key_pairs(
+    primary_subroutines.size(), secondary_subroutines.size(),
+    [&](size_t index) -> const std::vector<uint64_t>& {
+      return primary_subroutines[index].constants;
+    },
+    [&](size_t index) -> const std::vector<uint64_t>& {
+      return secondary_subroutines[index].constants;
+    }
+  ));
+
+  // every confirmed pair vouches for its unmatched callers and callees, rounds continue until nothing new matches
+  constexpr size_t neighbour_pair_limit = 64;
+  const auto primary_calls = make_call_graph(primary_subroutines);
+  const auto secondary_calls = make_call_graph(secondary_subroutines);
+  std::set<std::pair<size_t, size_t>> scored_neighbours;
+  for (size_t frontier_begin = 0; frontier_begin < matches.size();) {
+    const auto frontier_end = matches.size();
+    std::vector<candidate_pair> neighbour_pairs;
+    auto add_neighbours = [&](const std::vector<size_t>& primary_side, const std::vector<size_t>& secondary_side) {
+      std::vector<size_t> primary_open;
+      for (const auto index : primary_side) {
+        if (!matched_primary[index]) {
+          primary_open.push_back(index);
+        }
+      }
+      std::vector<size_t> secondary_open;
+      for (const auto index : secondary_side) {
+        if (!matched_secondary[index]) {
+          secondary_open.push_back(index);
+        }
+      }
+      // wide fan outs such as allocator callers say little about any single neighbour
+      if (primary_open.size() * secondary_open.size() > neighbour_pair_limit) {
+        return;
+      }
+      for (const auto primary_index : primary_open) {
+        for (const auto secondary_index : secondary_open) {
+          if (scored_neighbours.emplace(primary_index, secondary_index).second) {
+            neighbour_pairs.emplace_back(&primary_subroutines[primary_index], &secondary_subroutines[secondary_index]);
+          }
+        }
+      }
+    };
+    for (size_t i = frontier_begin; i < frontier_end; ++i) {
+      const auto& match = matches[i];
+      add_neighbours(primary_calls.callees[match.primary_index], secondary_calls.callees[match.secondary_index]);
+      add_neighbours(primary_calls.callers[match.primary_index], secondary_calls.callers[match.secondary_index]);
+    }
+    frontier_begin = frontier_end;
+    score_pairs(neighbour_pairs, options_.fallback_threshold);
+  }
+
   if (options_.fallback_limit == 0) {
+    prefiltered_candidates += prefiltered.load();
     return matches;
   }
 
   std::vector<const subroutine_analyzer::subroutine*> unmatched_primary;
   for (const auto& sub : primary_subroutines) {
-    if (!matched_primary_addrs.contains(sub.start_address)) {
+    if (!primary_matched(sub)) {
       unmatched_primary.push_back(&sub);
     }
   }
 
   std::vector<const subroutine_analyzer::subroutine*> unmatched_secondary;
   for (const auto& sub : secondary_subroutines) {
-    if (!matched_secondary_addrs.contains(sub.start_address)) {
+    if (!secondary_matched(sub)) {
       unmatched_secondary.push_back(&sub);
     }
   }
@@ -914,12 +1737,11 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
     const auto pair_count = unmatched_primary.size() > std::numeric_limits<size_t>::max() / unmatched_secondary.size()
                               ? std::numeric_limits<size_t>::max()
                               : unmatched_primary.size() * unmatched_secondary.size();
-    const bool limited_search = pair_count > options_.pair_limit;
     std::vector<candidate_pair> candidate_pairs;
-    candidate_pairs.reserve(std::min(pair_count, options_.pair_limit));
 
     struct ranked_candidate {
       const subroutine_analyzer::subroutine* secondary;
+      size_t sketch_overlap;
       double shape_ratio;
       double instruction_ratio;
       double byte_ratio;
@@ -927,6 +1749,9 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
       uint64_t distance;
     };
     auto compare_rank = [](const ranked_candidate& lhs, const ranked_candidate& rhs) {
+      if (lhs.sketch_overlap != rhs.sketch_overlap) {
+        return lhs.sketch_overlap > rhs.sketch_overlap;
+      }
       if (lhs.shape_ratio != rhs.shape_ratio) {
         return lhs.shape_ratio > rhs.shape_ratio;
       }
@@ -944,61 +1769,143 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
       }
       return lhs.secondary->start_address < rhs.secondary->start_address;
     };
+    auto rank_candidate = [&](const subroutine_analyzer::subroutine* primary_sub,
+                              const subroutine_analyzer::subroutine* secondary_sub) {
+      const auto block_ratio =
+        static_cast<double>(std::min(primary_sub->basic_blocks.size(), secondary_sub->basic_blocks.size())) /
+        static_cast<double>(
+          std::max({size_t{1}, primary_sub->basic_blocks.size(), secondary_sub->basic_blocks.size()})
+        );
+      const auto instruction_ratio =
+        static_cast<double>(std::min(primary_sub->instruction_count, secondary_sub->instruction_count)) /
+        static_cast<double>(std::max({size_t{1}, primary_sub->instruction_count, secondary_sub->instruction_count}));
+      const auto byte_ratio =
+        static_cast<double>(std::min(primary_sub->byte_size, secondary_sub->byte_size)) /
+        static_cast<double>(std::max({size_t{1}, primary_sub->byte_size, secondary_sub->byte_size}));
+      const auto distance = address_distance(primary_sub->start_address, secondary_sub->start_address);
+      return ranked_candidate{
+        .secondary = secondary_sub,
+        .sketch_overlap = sketch_overlap(*primary_sub, *secondary_sub),
+        .shape_ratio = std::min({block_ratio, instruction_ratio, byte_ratio}),
+        .instruction_ratio = instruction_ratio,
+        .byte_ratio = byte_ratio,
+        .nearby = distance <= options_.address_radius,
+        .distance = distance,
+      };
+    };
+    // keeps the best fallback_limit candidates of one primary, within what is left of pair_limit
+    auto add_ranked = [&](const subroutine_analyzer::subroutine* primary_sub, std::vector<ranked_candidate>& ranked) {
+      const auto remaining_limit = options_.pair_limit - candidate_pairs.size();
+      const auto candidate_limit = std::min({options_.fallback_limit, ranked.size(), remaining_limit});
+      std::ranges::partial_sort(ranked, ranked.begin() + static_cast<std::ptrdiff_t>(candidate_limit), compare_rank);
+      for (size_t i = 0; i < candidate_limit; ++i) {
+        candidate_pairs.emplace_back(primary_sub, ranked[i].secondary);
+      }
+    };
+
 
-    if (!limited_search) {
+    // every pair is scored while they fit in pair_limit, the candidate source only picks the pairs past it
+    if (pair_count <= options_.pair_limit) {
+      candidate_pairs.reserve(pair_count);
       for (const auto* primary_sub : unmatched_primary) {
         for (const auto* secondary_sub : unmatched_secondary) {
           candidate_pairs.emplace_back(primary_sub, secondary_sub);
         }
       }
-    } else {
+    } else if (options_.fallback_candidates == candidate_source::exhaustive) {
+      std::vector<ranked_candidate> ranked_candidates;
+      ranked_candidates.reserve(unmatched_secondary.size());
       for (const auto* primary_sub : unmatched_primary) {
         if (candidate_pairs.size() >= options_.pair_limit) {
           break;
         }
 
-        std::vector<ranked_candidate> ranked_candidates;
-        ranked_candidates.reserve(unmatched_secondary.size());
+        ranked_candidates.clear();
         for (const auto* secondary_sub : unmatched_secondary) {
-          const auto block_ratio =
-            static_cast<double>(std::min(primary_sub->basic_blocks.size(), secondary_sub->basic_blocks.size())) /
-            static_cast<double>(
-              std::max({size_t{1}, primary_sub->basic_blocks.size(), secondary_sub->basic_blocks.size()})
-            );
-          const auto instruction_ratio =
-            static_cast<double>(std::min(primary_sub->instruction_count, secondary_sub->instruction_count)) /
-            static_cast<double>(
-              std::max({size_t{1}, primary_sub->instruction_count, secondary_sub->instruction_count})
-            );
-          const auto byte_ratio =
-            static_cast<double>(std::min(primary_sub->byte_size, secondary_sub->byte_size)) /
-            static_cast<double>(std::max({size_t{1}, primary_sub->byte_size, secondary_sub->byte_size}));
-          const auto distance = address_distance(primary_sub->start_address, secondary_sub->start_address);
-          ranked_candidates.push_back({
-            .secondary = secondary_sub,
-            .shape_ratio = std::min({block_ratio, instruction_ratio, byte_ratio}),
-            .instruction_ratio = instruction_ratio,
-            .byte_ratio = byte_ratio,
-            .nearby = distance <= options_.address_radius,
-            .distance = distance,
-          });
+          ranked_candidates.push_back(rank_candidate(primary_sub, secondary_sub));
         }
+        add_ranked(primary_sub, ranked_candidates);
+      }
+    } else {
+      // subroutines without instructions have no sketch and only score against each other, so those pair up
+      // exhaustively and everything else is ranked from the minhash bands
+      std::vector<const subroutine_analyzer::subroutine*> sketched_secondary;
+      std::vector<const subroutine_analyzer::subroutine*> unsketched_secondary;
+      for (const auto* secondary_sub : unmatched_secondary) {
+        (has_sketch(*secondary_sub) ? sketched_secondary : unsketched_secondary).push_back(secondary_sub);
+      }
 
-        const auto remaining_limit = options_.pair_limit - candidate_pairs.size();
-        const auto candidate_limit = std::min({options_.fallback_limit, ranked_candidates.size(), remaining_limit});
-        std::ranges::partial_sort(
-          ranked_candidates, ranked_candidates.begin() + static_cast<std::ptrdiff_t>(candidate_limit), compare_rank
-        );
-        for (size_t i = 0; i < candidate_limit; ++i) {
-          candidate_pairs.emplace_back(primary_sub, ranked_candidates[i].secondary);
+      // bands that many subroutines share carry no signal and are left out
+      constexpr size_t band_bucket_limit = 64;
+      std::unordered_map<uint64_t, std::vector<uint32_t>> secondary_bands;
+      for (size_t i = 0; i < sketched_secondary.size(); ++i) {
+        for (size_t band = 0; band < sketch_bands; ++band) {
+          secondary_bands[band_hash(*sketched_secondary[i], band)].push_back(static_cast<uint32_t>(i));
         }
       }
-    }
 
-    skipped_candidates_ += pair_count > candidate_pairs.size() ? pair_count - candidate_pairs.size() : 0;
+      // nearest embeddings add candidates where the bands are too strict, at a log cost per primary
+      std::optional<vantage_point_tree> secondary_tree;
+      if (options_.fallback_candidates == candidate_source::neighbours && !sketched_secondary.empty()) {
+        std::vector<float> secondary_embeddings;
+        secondary_embeddings.reserve(sketched_secondary.size() * embedding_size);
+        for (const auto* secondary_sub : sketched_secondary) {
+          const auto values = make_embedding(*secondary_sub);
+          secondary_embeddings.insert(secondary_embeddings.end(), values.begin(), values.end());
+        }
+        secondary_tree.emplace(std::move(secondary_embeddings), embedding_size);
+      }
+
+      std::vector<ranked_candidate> ranked_candidates;
+      std::vector<size_t> seen_secondary(sketched_secondary.size(), 0);
+      size_t primary_stamp = 0;
+      std::vector<const subroutine_analyzer::subroutine*> unsketched_primary;
+      for (const auto* primary_sub : unmatched_primary) {
+        if (!has_sketch(*primary_sub)) {
+          unsketched_primary.push_back(primary_sub);
+          continue;
+        }
+        if (candidate_pairs.size() >= options_.pair_limit) {
+          continue;
+        }
+
+        ++primary_stamp;
+        ranked_candidates.clear();
+        auto collect = [&](uint32_t index) {
+          if (seen_secondary[index] != primary_stamp) {
+            seen_secondary[index] = primary_stamp;
+            ranked_candidates.push_back(rank_candidate(primary_sub, sketched_secondary[index]));
+          }
+        };
+        for (size_t band = 0; band < sketch_bands; ++band) {
+          const auto it = secondary_bands.find(band_hash(*primary_sub, band));
+          if (it == secondary_bands.end() || it->second.size() > band_bucket_limit) {
+            continue;
+          }
+          for (const auto index : it->second) {
+            collect(index);
+          }
+        }
+        if (secondary_tree) {
+          for (const auto index : secondary_tree->nearest(make_embedding(*primary_sub), options_.fallback_limit)) {
+            collect(static_cast<uint32_t>(index));
+          }
+        }
+        add_ranked(primary_sub, ranked_candidates);
+      }
+
+      const auto unsketched_pairs = unsketched_primary.size() * unsketched_secondary.size();
+      const auto unsketched_limit = std::min(unsketched_pairs, options_.pair_limit - candidate_pairs.size());
+      for (size_t i = 0; i < unsketched_limit; ++i) {
+        candidate_pairs.emplace_back(
+          unsketched_primary[i / unsketched_secondary.size()], unsketched_secondary[i % unsketched_secondary.size()]
+        );
+      }
+    }
+    skipped_candidates += pair_count - candidate_pairs.size();
 
     const auto thread_count =
-      std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), candidate_pairs.size());
+      std::min<size_t>(worker_count(), candidate_pairs.size());
     std::atomic_size_t next_candidate{0};
     std::stop_source scoring_stop;
     std::exception_ptr scoring_failure;
@@ -1018,7 +1925,10 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
               }
 
               const auto [primary_sub, secondary_sub] = candidate_pairs[index];
-              const auto similarity = score_subroutines(*primary_sub, *secondary_sub);
+              if (!prefilter(*primary_sub, *secondary_sub, options_.fallback_threshold)) {
+                continue;
+              }
+              const auto similarity = score_subroutines(*primary_sub, *secondary_sub, options_.fallback_threshold);
               if (similarity > options_.fallback_threshold) {
                 output.push_back({.similarity = similarity, .primary = primary_sub, .secondary = secondary_sub});
               }
@@ -1053,5 +1963,6 @@ std::vector<binary_differ::match_index> binary_differ::match_subroutines(
     resolve_matches(fallback_matches);
   }
 
+  prefiltered_candidates += prefiltered.load();
   return matches;
 }
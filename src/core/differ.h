@@ -2,12 +2,17 @@
 
 #include <cstdint>
 #include <expected>
+#include <functional>
 #include <memory>
 #include <optional>
+#include <span>
+#include <stop_token>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include "analyzer.h"
 #include "parser.h"
+#include "regions.h"
 
 class binary_differ {
   public:
@@ -29,6 +34,18 @@ class binary_differ {
     instructions_unavailable,
   };
 
+  // where the fallback phase takes the pairs it scores from once the unmatched pairs exceed pair_limit, below it every
+  // pair is scored
+  enum class candidate_source : uint8_t {
+    // the best fallback_limit of all unmatched secondaries for each primary
+    exhaustive,
+    // the best fallback_limit secondaries sharing a minhash band with each primary. subroutines without
+    // instructions have no sketch and pair exhaustively
+    bands,
+    // bands plus the fallback_limit nearest embeddings of each primary
+    neighbours,
+  };
+
   struct instruction_edit {
     edit_type type{edit_type::unchanged};
     std::optional<std::string> primary;
@@ -48,7 +65,19 @@ class binary_differ {
     size_t pair_limit{5'000'000};
     size_t delta_limit{16};
     bool include_instructions{true};
-    size_t fallback_limit{4};
+    size_t fallback_limit{16};
+    candidate_source fallback_candidates{candidate_source::neighbours};
+    // analysis snapshots are loaded from and stored in this directory when set
+    std::string cache_directory{};
+    // analyze the secondary after the primary and copy functions whose bytes only differ in relocations
+    bool incremental{false};
+    // pair known start ranges that only differ in relocations as unchanged before analyzing anything.
+    // those matches carry no basic blocks
+    bool skip_identical{false};
+    // byte identical text runs at least this long pin the shift of the code inside them, zero disables the scan
+    size_t region_min_length{512};
+    // threads for analysis and scoring, zero uses every hardware thread. results never depend on it
+    size_t worker_count{0};
   };
 
   struct matched_subroutine {
@@ -56,6 +85,8 @@ class binary_differ {
     subroutine_analyzer::subroutine secondary;
     change_type change{change_type::unchanged};
     double similarity{};
+
+    [[nodiscard]] auto operator==(const matched_subroutine&) const -> bool = default;
   };
 
   struct block_match {
@@ -69,18 +100,43 @@ class binary_differ {
     std::vector<subroutine_analyzer::subroutine> unmatched_secondary;
     size_t primary_count{0};
     size_t secondary_count{0};
+    // unmatched pairs the fallback phase left unscored past pair_limit
     size_t skipped_candidates{0};
+    // candidate pairs never scored because score_bound showed they cannot clear their threshold
+    size_t prefiltered_candidates{0};
+
+    [[nodiscard]] auto operator==(const diff_result&) const -> bool = default;
+  };
+
+  // takes matches and unmatched subroutines as diff hands them over instead of the result collecting them. members
+  // left empty keep collecting into the result
+  struct result_sink {
+    std::function<void(matched_subroutine&&)> match{};
+    std::function<void(subroutine_analyzer::subroutine&&)> unmatched_primary{};
+    std::function<void(subroutine_analyzer::subroutine&&)> unmatched_secondary{};
   };
 
   binary_differ(const std::string& primary_path, const std::string& secondary_path);
   binary_differ(const std::string& primary_path, const std::string& secondary_path, compare_options options);
+  // one-to-many mode: the primary is analyzed once and reused for every secondary
+  binary_differ(const std::string& primary_path, compare_options options);
 
   diff_result compare();
+  diff_result compare(const result_sink& sink);
+  diff_result compare(const std::string& secondary_path);
+  std::vector<diff_result> compare(std::span<const std::string> secondary_paths, size_t concurrency = 1);
   static std::vector<block_match>
   match_blocks(const subroutine_analyzer::subroutine& primary, const subroutine_analyzer::subroutine& secondary);
   static std::expected<std::vector<block_diff>, detail_error>
   diff_blocks(const subroutine_analyzer::subroutine& primary, const subroutine_analyzer::subroutine& secondary);
   static std::expected<std::vector<block_diff>, detail_error> diff_blocks(const matched_subroutine& match);
+  // never below score_subroutines, read from the block counts and block size lanes of the features alone
+  static double score_bound(const subroutine_analyzer::subroutine& s1, const subroutine_analyzer::subroutine& s2);
+  // stops once the score provably cannot exceed threshold and returns that bound instead, a negative threshold
+  // scores every block
+  static double score_subroutines(
+    const subroutine_analyzer::subroutine& s1, const subroutine_analyzer::subroutine& s2, double threshold
+  );
 
   private:
   struct match_index {
@@ -89,15 +145,69 @@ class binary_differ {
     double similarity{};
   };
 
-  double score_subroutines(const subroutine_analyzer::subroutine& s1, const subroutine_analyzer::subroutine& s2);
+  struct match_key {
+    fingerprint code_fingerprint{};
+    size_t instruction_count{};
+
+    [[nodiscard]] auto operator==(const match_key&) const -> bool = default;
+  };
+
+  struct match_key_hash {
+    [[nodiscard]] auto operator()(const match_key& key) const -> size_t;
+  };
+
+  // subroutines sorted by start address plus the exact match buckets built over them
+  struct analysis {
+    std::vector<subroutine_analyzer::subroutine> subroutines;
+    std::unordered_map<match_key, std::vector<size_t>, match_key_hash> buckets;
+    std::unordered_map<uint64_t, std::vector<size_t>> graph_buckets;
+    // per subroutine hashes of the strings and data its data_refs point at
+    std::vector<std::vector<uint64_t>> reference_keys;
+  };
+
+  // an exact bucket pair scored at the match threshold while analysis was still running
+  struct prescored_pair {
+    uint64_t secondary_address{};
+    double similarity{};
+  };
+
+  // pairings known before any scoring runs
+  struct match_hints {
+    std::vector<match_index> prematched{};
+    std::vector<text_regions::region> regions{};
+    // keyed by primary start address
+    std::unordered_map<uint64_t, prescored_pair> prescored{};
+  };
+
+  size_t worker_count() const;
+  subroutine_analyzer make_analyzer(const binary_parser& parser, size_t worker_count, std::stop_token stop_token) const;
+  analysis analyze(
+    const binary_parser& parser, size_t worker_count, std::stop_token stop_token,
+    std::span<const subroutine_analyzer::subroutine> prior, std::vector<subroutine_analyzer::subroutine> identical,
+    std::function<void(const subroutine_analyzer::subroutine&)> observer = {}
+  ) const;
+  const analysis& primary_analysis();
+  std::vector<text_regions::region> find_regions(const binary_parser& primary, const binary_parser& secondary) const;
+  // a shared primary is only read, its subroutines are copied into the result
+  diff_result
+  diff(const analysis& primary, analysis&& secondary, const match_hints& hints, const result_sink& sink) const;
+  // a primary diffed once hands its subroutines over to the result
+  diff_result diff(analysis&& primary, analysis&& secondary, const match_hints& hints, const result_sink& sink) const;
+  template <typename primary_analysis_type>
+  diff_result diff_analyses(
+    primary_analysis_type& primary, analysis& secondary, const match_hints& hints, const result_sink& sink
+  ) const;
+
+  prescored_pair
+  prescore(const subroutine_analyzer::subroutine& primary, const subroutine_analyzer::subroutine& secondary) const;
 
   std::vector<match_index> match_subroutines(
-    const std::vector<subroutine_analyzer::subroutine>& primary_subroutines,
-    const std::vector<subroutine_analyzer::subroutine>& secondary_subroutines
-  );
+    const analysis& primary, const analysis& secondary, const match_hints& hints, size_t& skipped_candidates,
+    size_t& prefiltered_candidates
+  ) const;
 
   std::unique_ptr<binary_parser> primary_;
   std::unique_ptr<binary_parser> secondary_;
   compare_options options_;
-  size_t skipped_candidates_{0};
+  std::optional<analysis> primary_analysis_;
 };
@@ -0,0 +1,123 @@
+#include "mapping.h"
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+file_mapping::file_mapping(file_mapping&& other) noexcept :
+    data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {
+}
+
+auto file_mapping::operator=(file_mapping&& other) noexcept -> file_mapping& {
+  if (this != &other) {
+    release();
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+  }
+  return *this;
+}
+
+file_mapping::~file_mapping() {
+  release();
+}
+
+#ifdef _WIN32
+
+auto file_mapping::open(const std::string& filepath) -> std::expected<file_mapping, std::string> {
+  const auto file = CreateFileA(
+    filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr
+  );
+  if (file == INVALID_HANDLE_VALUE) {
+    return std::unexpected("failed to open file");
+  }
+
+  LARGE_INTEGER size{};
+  if (!GetFileSizeEx(file, &size)) {
+    CloseHandle(file);
+    return std::unexpected("failed to query file size");
+  }
+
+  file_mapping mapping;
+  if (size.QuadPart == 0) {
+    CloseHandle(file);
+    return mapping;
+  }
+
+  // the view keeps the section and the file alive on its own
+  const auto section = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (!section) {
+    return std::unexpected("failed to map file");
+  }
+  const auto* view = MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(section);
+  if (!view) {
+    return std::unexpected("failed to map file");
+  }
+
+  mapping.data_ = static_cast<const uint8_t*>(view);
+  mapping.size_ = static_cast<size_t>(size.QuadPart);
+  return mapping;
+}
+
+void file_mapping::release() {
+  if (data_) {
+    UnmapViewOfFile(data_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+#else
+
+auto file_mapping::open(const std::string& filepath) -> std::expected<file_mapping, std::string> {
+  const auto file = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+  if (file < 0) {
+    return std::unexpected("failed to open file");
+  }
+
+  struct stat status {};
+  if (fstat(file, &status) != 0) {
+    close(file);
+    return std::unexpected("failed to query file size");
+  }
+
+  file_mapping mapping;
+  if (status.st_size == 0) {
+    close(file);
+    return mapping;
+  }
+
+  // the mapping keeps its own reference to the file
+  auto* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+  if (view == MAP_FAILED) {
+    return std::unexpected("failed to map file");
+  }
+
+  mapping.data_ = static_cast<const uint8_t*>(view);
+  mapping.size_ = static_cast<size_t>(status.st_size);
+  return mapping;
+}
+
+void file_mapping::release() {
+  if (data_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+
+// read-only mapping of a whole file, the bytes stay valid for the lifetime of the object
+class file_mapping {
+  public:
+  file_mapping() = default;
+  file_mapping(const file_mapping&) = delete;
+  file_mapping(file_mapping&& other) noexcept;
+  auto operator=(const file_mapping&) -> file_mapping& = delete;
+  auto operator=(file_mapping&& other) noexcept -> file_mapping&;
+  ~file_mapping();
+
+  [[nodiscard]] static auto open(const std::string& filepath) -> std::expected<file_mapping, std::string>;
+
+  [[nodiscard]] auto data() const -> std::span<const uint8_t> {
+    return {data_, size_};
+  }
+
+  private:
+  void release();
+
+  const uint8_t* data_{nullptr};
+  size_t size_{0};
+};
@@ -0,0 +1,138 @@
+#include "core/regions.h"
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <unordered_map>
+
+namespace {
+
+  constexpr size_t bucket_limit = 8;
+
+  // adler style checksum that can slide one byte at a time
+  class rolling_checksum {
+    public:
+    void reset(std::span<const uint8_t> window) {
+      a_ = 0;
+      b_ = 0;
+      length_ = static_cast<uint32_t>(window.size());
+      for (size_t i = 0; i < window.size(); ++i) {
+        a_ += window[i];
+        b_ += static_cast<uint32_t>(window.size() - i) * window[i];
+      }
+    }
+
+    void roll(uint8_t removed, uint8_t added) {
+      a_ += added - removed;
+      b_ += a_ - length_ * removed;
+    }
+
+    [[nodiscard]] auto value() const -> uint32_t {
+      return (a_ & 0xffff) | (b_ << 16);
+    }
+
+    private:
+    uint32_t a_{0};
+    uint32_t b_{0};
+    uint32_t length_{0};
+  };
+
+  [[nodiscard]] auto is_uniform(std::span<const uint8_t> block) -> bool {
+    return std::ranges::all_of(block, [&](uint8_t value) {
+      return value == block.front();
+    });
+  }
+
+} // namespace
+
+std::vector<text_regions::region> text_regions::find(
+  std::span<const uint8_t> primary, uint64_t primary_base, std::span<const uint8_t> secondary,
+  uint64_t secondary_base, options opts
+) {
+  std::vector<region> regions;
+  const auto block_size = std::max(size_t{8}, opts.block_size);
+  const auto min_length = std::max(block_size, opts.min_length);
+  if (primary.size() < block_size || secondary.size() < block_size) {
+    return regions;
+  }
+
+  // padding and zero fill would match everywhere, so only varied blocks are indexed
+  std::unordered_map<uint32_t, std::vector<size_t>> primary_blocks;
+  primary_blocks.reserve(primary.size() / block_size);
+  rolling_checksum checksum;
+  for (size_t offset = 0; offset + block_size <= primary.size(); offset += block_size) {
+    const auto block = primary.subspan(offset, block_size);
+    if (is_uniform(block)) {
+      continue;
+    }
+    checksum.reset(block);
+    auto& bucket = primary_blocks[checksum.value()];
+    if (bucket.size() < bucket_limit) {
+      bucket.push_back(offset);
+    }
+  }
+
+  std::optional<int64_t> last_shift;
+  size_t offset = 0;
+  checksum.reset(secondary.subspan(0, block_size));
+  while (offset + block_size <= secondary.size()) {
+    std::optional<size_t> match;
+    if (const auto it = primary_blocks.find(checksum.value()); it != primary_blocks.end()) {
+      for (const auto candidate : it->second) {
+        if (std::memcmp(primary.data() + candidate, secondary.data() + offset, block_size) != 0) {
+          continue;
+        }
+        // keep following the previous shift when duplicated code offers a choice
+        const auto shift = static_cast<int64_t>(offset) - static_cast<int64_t>(candidate);
+        if (!match || (last_shift && shift == *last_shift)) {
+          match = candidate;
+        }
+      }
+    }
+
+    if (!match) {
+      if (offset + block_size < secondary.size()) {
+        checksum.roll(secondary[offset], secondary[offset + block_size]);
+      }
+      ++offset;
+      continue;
+    }
+
+    auto primary_begin = *match;
+    auto secondary_begin = offset;
+    const auto secondary_floor = regions.empty() ? 0 : static_cast<size_t>(
+                                                          regions.back().secondary_address - secondary_base +
+                                                          regions.back().size
+                                                        );
+    while (primary_begin > 0 && secondary_begin > secondary_floor &&
+           primary[primary_begin - 1] == secondary[secondary_begin - 1]) {
+      --primary_begin;
+      --secondary_begin;
+    }
+    auto length = offset - secondary_begin + block_size;
+    while (primary_begin + length < primary.size() && secondary_begin + length < secondary.size() &&
+           primary[primary_begin + length] == secondary[secondary_begin + length]) {
+      ++length;
+    }
+
+    if (length >= min_length) {
+      regions.push_back({
+        .primary_address = primary_base + primary_begin,
+        .secondary_address = secondary_base + secondary_begin,
+        .size = length,
+      });
+      last_shift = static_cast<int64_t>(secondary_begin) - static_cast<int64_t>(primary_begin);
+      offset = secondary_begin + length;
+    } else {
+      ++offset;
+    }
+
+    if (offset + block_size <= secondary.size()) {
+      checksum.reset(secondary.subspan(offset, block_size));
+    }
+  }
+
+  std::ranges::sort(regions, [](const auto& lhs, const auto& rhs) {
+    return lhs.primary_address < rhs.primary_address;
+  });
+  return regions;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// rsync style search for long byte identical runs shared by two text sections, possibly shifted
+class text_regions {
+  public:
+  struct options {
+    size_t block_size{64};
+    size_t min_length{512};
+  };
+
+  struct region {
+    uint64_t primary_address{};
+    uint64_t secondary_address{};
+    uint64_t size{};
+
+    [[nodiscard]] auto delta() const -> int64_t {
+      return static_cast<int64_t>(secondary_address - primary_address);
+    }
+  };
+
+  // regions are ordered by primary address and never overlap on the secondary side
+  [[nodiscard]] static std::vector<region> find(
+    std::span<const uint8_t> primary, uint64_t primary_base, std::span<const uint8_t> secondary,
+    uint64_t secondary_base, options opts
+  );
+};
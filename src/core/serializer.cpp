@@ -1,354 +1,511 @@
 #include "serializer.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
 #include <cstring>
-#include <fstream>
-#include <optional>
-#include <span>
-#include <string_view>
-#include <type_traits>
+#include <mutex>
+#include <thread>
+#include <utility>
 #include <vector>
+#include "mapping.h"
+#include "view.h"
 
 namespace {
 
   constexpr uint32_t format_magic = 0x5a594446; // zydf
-  constexpr uint32_t format_version = 5;
-
-  class buffer_writer {
-public:
-    template <typename T>
-      requires std::is_trivially_copyable_v<T>
-    void write(const T& value) {
-      const auto* ptr = reinterpret_cast<const uint8_t*>(&value);
-      buffer_.insert(buffer_.end(), ptr, ptr + sizeof(T));
-    }
-
-    void write_string(std::string_view str) {
-      write(static_cast<uint32_t>(str.size()));
-      const auto* ptr = reinterpret_cast<const uint8_t*>(str.data());
-      buffer_.insert(buffer_.end(), ptr, ptr + str.size());
-    }
-
-    [[nodiscard]] auto save_to_file(const std::string& filepath) const -> bool {
-      std::ofstream os(filepath, std::ios::binary);
-      if (!os) {
-        return false;
-      }
-      os.write(reinterpret_cast<const char*>(buffer_.data()), static_cast<std::streamsize>(buffer_.size()));
-      return os.good();
-    }
-
-private:
-    std::vector<uint8_t> buffer_;
+  constexpr uint32_t format_version = 15;
+  constexpr size_t header_size = 2 * sizeof(uint32_t);
+  // the footer offset and the magic again close every file
+  constexpr size_t trailer_size = sizeof(uint64_t) + sizeof(uint32_t);
+
+  enum class record_type : uint8_t {
+    match,
+    unmatched_primary,
+    unmatched_secondary,
   };
 
-  class buffer_reader {
-public:
-    explicit buffer_reader(std::span<const uint8_t> data) : data_(data) {
-    }
-
-    template <typename T>
-      requires std::is_trivially_copyable_v<T>
-    [[nodiscard]] auto read() -> std::optional<T> {
-      if (sizeof(T) > data_.size() - offset_) {
-        return std::nullopt;
-      }
-      T value;
-      std::memcpy(&value, data_.data() + offset_, sizeof(T));
-      offset_ += sizeof(T);
-      return value;
-    }
-
-    [[nodiscard]] auto read_string() -> std::optional<std::string> {
-      auto len = read<uint32_t>();
-      if (!len || *len > data_.size() - offset_) {
-        return std::nullopt;
-      }
-      std::string str(reinterpret_cast<const char*>(data_.data() + offset_), *len);
-      offset_ += *len;
-      return str;
-    }
-
-private:
-    std::span<const uint8_t> data_;
-    size_t offset_{0};
+  // what a reader needs besides the records, the spans borrow the file bytes
+  struct footer {
+    binary_differ::diff_result totals;
+    uint64_t match_count{};
+    uint64_t unmatched_primary_count{};
+    uint64_t unmatched_secondary_count{};
+    subroutine_codec::dictionary dict;
+    std::span<const uint8_t> records;
+    std::span<const uint8_t> record_offsets;
+    std::span<const uint8_t> primary_index;
+    std::span<const uint8_t> secondary_index;
   };
 
-  void write_basic_block(buffer_writer& bw, const subroutine_analyzer::basic_block& bb) {
-    bw.write(bb.start_address);
-    bw.write(bb.end_address);
-
-    bw.write(static_cast<uint32_t>(bb.successor_keys.size()));
-    for (const auto key : bb.successor_keys) {
-      bw.write(key);
-    }
-
-    bw.write(static_cast<uint32_t>(bb.instruction_keys.size()));
-    for (const auto key : bb.instruction_keys) {
-      bw.write(key);
-    }
-    bw.write(static_cast<uint32_t>(bb.match_keys.size()));
-    for (const auto key : bb.match_keys) {
-      bw.write(key);
-    }
-    bw.write(bb.match_hash);
-
-    bw.write(static_cast<uint32_t>(bb.instructions.size()));
-    for (const auto& instr : bb.instructions) {
-      bw.write_string(instr);
+  [[nodiscard]] auto read_table(buffer_reader& br, size_t element_size) -> std::optional<std::span<const uint8_t>> {
+    const auto count = br.read<uint64_t>();
+    if (!count || *count > br.remaining() / element_size) {
+      return std::nullopt;
     }
+    return br.read_bytes(static_cast<size_t>(*count) * element_size);
   }
 
-  void write_subroutine(buffer_writer& bw, const subroutine_analyzer::subroutine& sub) {
-    bw.write(sub.start_address);
-    bw.write(sub.end_address);
-    bw.write(static_cast<uint64_t>(sub.fingerprint));
-    bw.write(static_cast<uint64_t>(sub.byte_size));
-    bw.write(static_cast<uint64_t>(sub.instruction_count));
-    bw.write(sub.instruction_hash);
-
-    bw.write(static_cast<uint32_t>(sub.basic_blocks.size()));
-    for (const auto& bb : sub.basic_blocks) {
-      write_basic_block(bw, bb);
+  [[nodiscard]] auto read_footer(std::span<const uint8_t> bytes) -> std::expected<footer, std::string> {
+    buffer_reader br(bytes);
+    auto magic = br.read<uint32_t>();
+    auto version = br.read<uint32_t>();
+    if (!magic || *magic != format_magic) {
+      return std::unexpected("invalid file magic");
     }
-  }
-
-  auto read_basic_block(buffer_reader& br) -> std::expected<subroutine_analyzer::basic_block, std::string> {
-    subroutine_analyzer::basic_block bb;
-
-    auto start = br.read<uint64_t>();
-    auto end = br.read<uint64_t>();
-    if (!start || !end) {
-      return std::unexpected("corrupt basic_block header");
+    if (!version || *version != format_version) {
+      return std::unexpected("unsupported format version");
     }
 
-    bb.start_address = *start;
-    bb.end_address = *end;
-
-    auto successor_count = br.read<uint32_t>();
-    if (!successor_count) {
-      return std::unexpected("corrupt basic_block successor keys");
+    if (bytes.size() < header_size + trailer_size) {
+      return std::unexpected("file too small to contain valid footer");
     }
-    bb.successor_keys.reserve(*successor_count);
-    for (uint32_t i = 0; i < *successor_count; ++i) {
-      auto key = br.read<int64_t>();
-      if (!key) {
-        return std::unexpected("corrupt basic_block successor key");
-      }
-      bb.successor_keys.push_back(*key);
+    buffer_reader trailer(bytes.last(trailer_size));
+    auto footer_offset = trailer.read<uint64_t>();
+    auto trailer_magic = trailer.read<uint32_t>();
+    if (
+      !footer_offset || !trailer_magic || *trailer_magic != format_magic || *footer_offset < header_size ||
+      *footer_offset > bytes.size() - trailer_size
+    ) {
+      return std::unexpected("corrupt footer offset");
     }
 
-    auto key_count = br.read<uint32_t>();
-    if (!key_count) {
-      return std::unexpected("corrupt basic_block instruction keys");
-    }
-    bb.instruction_keys.reserve(*key_count);
-    for (uint32_t i = 0; i < *key_count; ++i) {
-      auto key = br.read<uint64_t>();
-      if (!key) {
-        return std::unexpected("corrupt basic_block instruction key");
-      }
-      bb.instruction_keys.push_back(*key);
-    }
-    auto match_count = br.read<uint32_t>();
-    if (!match_count) {
-      return std::unexpected("corrupt basic_block match keys");
+    footer parsed;
+    const auto footer_start = static_cast<size_t>(*footer_offset);
+    parsed.records = bytes.subspan(header_size, footer_start - header_size);
+    buffer_reader fr(bytes.subspan(footer_start, bytes.size() - trailer_size - footer_start));
+    auto primary_count = fr.read<uint64_t>();
+    auto secondary_count = fr.read<uint64_t>();
+    auto skipped_candidates = fr.read<uint64_t>();
+    auto prefiltered_candidates = fr.read<uint64_t>();
+    if (!primary_count || !secondary_count || !skipped_candidates || !prefiltered_candidates) {
+      return std::unexpected("corrupt result counts");
     }
-    bb.match_keys.reserve(*match_count);
-    for (uint32_t i = 0; i < *match_count; ++i) {
-      auto key = br.read<uint64_t>();
-      if (!key) {
-        return std::unexpected("corrupt basic_block match key");
-      }
-      bb.match_keys.push_back(*key);
+    parsed.totals.primary_count = static_cast<size_t>(*primary_count);
+    parsed.totals.secondary_count = static_cast<size_t>(*secondary_count);
+    parsed.totals.skipped_candidates = static_cast<size_t>(*skipped_candidates);
+    parsed.totals.prefiltered_candidates = static_cast<size_t>(*prefiltered_candidates);
+
+    auto match_count = fr.read<uint64_t>();
+    auto up_count = fr.read<uint64_t>();
+    auto us_count = fr.read<uint64_t>();
+    if (!match_count || !up_count || !us_count) {
+      return std::unexpected("corrupt record counts");
     }
-    auto match_hash = br.read<uint64_t>();
-    if (!match_hash) {
-      return std::unexpected("corrupt basic_block match hash");
+    // every record takes more than a byte, larger counts can only come from a corrupt file
+    const auto records_size = parsed.records.size();
+    if (*match_count > records_size || *up_count > records_size || *us_count > records_size) {
+      return std::unexpected("invalid record counts");
     }
-    bb.match_hash = *match_hash;
+    parsed.match_count = *match_count;
+    parsed.unmatched_primary_count = *up_count;
+    parsed.unmatched_secondary_count = *us_count;
 
-    auto inst_count = br.read<uint32_t>();
-    if (!inst_count) {
-      return std::unexpected("corrupt basic_block instruction count");
+    auto dict = subroutine_codec::dictionary::read(fr);
+    if (!dict) {
+      return std::unexpected(dict.error());
     }
+    parsed.dict = *dict;
 
-    bb.instructions.reserve(*inst_count);
-    for (uint32_t i = 0; i < *inst_count; ++i) {
-      auto inst = br.read_string();
-      if (!inst) {
-        return std::unexpected("corrupt basic_block instruction");
-      }
-      bb.instructions.push_back(std::move(*inst));
+    auto record_offsets = read_table(fr, sizeof(uint64_t));
+    auto primary_index = read_table(fr, sizeof(diff_writer::index_entry));
+    auto secondary_index = read_table(fr, sizeof(diff_writer::index_entry));
+    if (!record_offsets || !primary_index || !secondary_index) {
+      return std::unexpected("corrupt record index");
     }
-
-    return bb;
+    if (record_offsets->size() / sizeof(uint64_t) != *match_count + *up_count + *us_count) {
+      return std::unexpected("record index does not match the record counts");
+    }
+    parsed.record_offsets = *record_offsets;
+    parsed.primary_index = *primary_index;
+    parsed.secondary_index = *secondary_index;
+    return parsed;
   }
 
-  auto read_subroutine(buffer_reader& br) -> std::expected<subroutine_analyzer::subroutine, std::string> {
-    subroutine_analyzer::subroutine sub;
+  [[nodiscard]] auto read_match(buffer_reader& br, const subroutine_codec::dictionary& dict)
+    -> std::expected<binary_differ::matched_subroutine, std::string> {
+    auto p = subroutine_codec::read(br, dict);
+    if (!p)
+      return std::unexpected(p.error());
 
-    auto start = br.read<uint64_t>();
-    auto end = br.read<uint64_t>();
-    auto fp = br.read<uint64_t>();
-    auto byte_size = br.read<uint64_t>();
-    auto instruction_count = br.read<uint64_t>();
-    auto instruction_hash = br.read<uint64_t>();
-    auto bb_count = br.read<uint32_t>();
+    auto s = subroutine_codec::read(br, dict);
+    if (!s)
+      return std::unexpected(s.error());
 
-    if (!start || !end || !fp || !byte_size || !instruction_count || !instruction_hash || !bb_count) {
-      return std::unexpected("corrupt subroutine header");
+    auto change = br.read<binary_differ::change_type>();
+    auto similarity = br.read<double>();
+    if (!change || !similarity) {
+      return std::unexpected("corrupt match metadata");
+    }
+    if (
+      *change > binary_differ::change_type::instructions_changed || !std::isfinite(*similarity) || *similarity < 0.0 ||
+      *similarity > 1.0
+    ) {
+      return std::unexpected("invalid match metadata");
     }
+    return binary_differ::matched_subroutine{
+      .primary = std::move(*p),
+      .secondary = std::move(*s),
+      .change = *change,
+      .similarity = *similarity,
+    };
+  }
 
-    sub.start_address = *start;
-    sub.end_address = *end;
-    sub.fingerprint = static_cast<fingerprint>(*fp);
-    sub.byte_size = static_cast<size_t>(*byte_size);
-    sub.instruction_count = static_cast<size_t>(*instruction_count);
-    sub.instruction_hash = *instruction_hash;
-
-    sub.basic_blocks.reserve(*bb_count);
-    for (uint32_t i = 0; i < *bb_count; ++i) {
-      auto bb = read_basic_block(br);
-      if (!bb) {
-        return std::unexpected(bb.error());
-      }
-      sub.basic_blocks.push_back(std::move(*bb));
+  // decodes one tagged record and appends it where it belongs in result
+  [[nodiscard]] auto read_record(
+    buffer_reader& br, const subroutine_codec::dictionary& dict, binary_differ::diff_result& result
+  ) -> std::expected<void, std::string> {
+    auto type = br.read<record_type>();
+    if (!type) {
+      return std::unexpected("corrupt record type");
     }
 
-    return sub;
+    if (*type == record_type::match) {
+      auto match = read_match(br, dict);
+      if (!match)
+        return std::unexpected(match.error());
+      result.matches.push_back(std::move(*match));
+      return {};
+    }
+
+    if (*type != record_type::unmatched_primary && *type != record_type::unmatched_secondary) {
+      return std::unexpected("invalid record type");
+    }
+    auto sub = subroutine_codec::read(br, dict);
+    if (!sub)
+      return std::unexpected(sub.error());
+    auto& unmatched = *type == record_type::unmatched_primary ? result.unmatched_primary : result.unmatched_secondary;
+    unmatched.push_back(std::move(*sub));
+    return {};
   }
 
 } // namespace
 
 auto diff_serializer::save(const binary_differ::diff_result& result, const std::string& filepath) -> bool {
-  buffer_writer bw;
-
-  bw.write(format_magic);
-  bw.write(format_version);
-  bw.write(static_cast<uint64_t>(result.primary_count));
-  bw.write(static_cast<uint64_t>(result.secondary_count));
-  bw.write(static_cast<uint64_t>(result.skipped_candidates));
-
-  bw.write(static_cast<uint32_t>(result.matches.size()));
+  auto writer = diff_writer::open(filepath);
+  if (!writer) {
+    return false;
+  }
   for (const auto& match : result.matches) {
-    write_subroutine(bw, match.primary);
-    write_subroutine(bw, match.secondary);
-    bw.write(match.change);
-    bw.write(match.similarity);
+    writer->add_match(match);
   }
-
-  bw.write(static_cast<uint32_t>(result.unmatched_primary.size()));
   for (const auto& sub : result.unmatched_primary) {
-    write_subroutine(bw, sub);
+    writer->add_unmatched_primary(sub);
   }
-
-  bw.write(static_cast<uint32_t>(result.unmatched_secondary.size()));
   for (const auto& sub : result.unmatched_secondary) {
-    write_subroutine(bw, sub);
+    writer->add_unmatched_secondary(sub);
   }
-
-  return bw.save_to_file(filepath);
+  return writer->finish({
+    .primary_count = result.primary_count,
+    .secondary_count = result.secondary_count,
+    .skipped_candidates = result.skipped_candidates,
+    .prefiltered_candidates = result.prefiltered_candidates,
+  });
 }
 
-auto diff_serializer::load(const std::string& filepath) -> std::expected<binary_differ::diff_result, std::string> {
-  std::ifstream is(filepath, std::ios::binary | std::ios::ate);
-  if (!is) {
-    return std::unexpected("failed to open file");
+auto diff_serializer::load(const std::string& filepath, size_t worker_count)
+  -> std::expected<binary_differ::diff_result, std::string> {
+  auto mapping = file_mapping::open(filepath);
+  if (!mapping) {
+    return std::unexpected(mapping.error());
   }
-
-  auto size = is.tellg();
-  if (size < 8) {
+  const auto bytes = mapping->data();
+  if (bytes.size() < header_size) {
     return std::unexpected("file too small to contain valid header");
   }
 
-  is.seekg(0, std::ios::beg);
-  std::vector<uint8_t> buffer(static_cast<size_t>(size));
-  if (!is.read(reinterpret_cast<char*>(buffer.data()), size)) {
-    return std::unexpected("failed to read file content");
+  if (diff_view::is_table(bytes)) {
+    auto view = diff_view::open(filepath);
+    if (!view) {
+      return std::unexpected(view.error());
+    }
+    return view->materialize();
   }
 
-  buffer_reader br(buffer);
-
-  auto magic = br.read<uint32_t>();
-  auto version = br.read<uint32_t>();
+  auto parsed = read_footer(bytes);
+  if (!parsed) {
+    return std::unexpected(parsed.error());
+  }
 
-  if (!magic || *magic != format_magic) {
-    return std::unexpected("invalid file magic");
+  // one pass over the offset table gives every record its bytes and its slot, so workers can decode in any order.
+  // records have to tile the record area exactly
+  struct placement {
+    record_type type;
+    size_t slot;
+    std::span<const uint8_t> bytes;
+  };
+  const auto record_count = parsed->record_offsets.size() / sizeof(uint64_t);
+  const auto records_start = static_cast<uint64_t>(parsed->records.data() - bytes.data());
+  const auto records_end = records_start + parsed->records.size();
+  std::vector<placement> placements(record_count);
+  std::array<size_t, 3> type_counts{};
+  auto record_offset = [&](size_t i) {
+    if (i == record_count) {
+      return records_end;
+    }
+    uint64_t offset{};
+    std::memcpy(&offset, parsed->record_offsets.data() + i * sizeof(offset), sizeof(offset));
+    return offset;
+  };
+  auto next_offset = records_start;
+  for (size_t i = 0; i < record_count; ++i) {
+    const auto begin = next_offset;
+    next_offset = record_offset(i + 1);
+    if (record_offset(i) != begin || next_offset <= begin || next_offset > records_end) {
+      return std::unexpected("corrupt record offset");
+    }
+    const auto type = static_cast<record_type>(bytes[static_cast<size_t>(begin)]);
+    if (type > record_type::unmatched_secondary) {
+      return std::unexpected("invalid record type");
+    }
+    placements[i] = {
+      .type = type,
+      .slot = type_counts[static_cast<size_t>(type)]++,
+      .bytes = bytes.subspan(static_cast<size_t>(begin), static_cast<size_t>(next_offset - begin)),
+    };
   }
-  if (!version || *version != format_version) {
-    return std::unexpected("unsupported format version");
+  if (
+    next_offset != records_end || type_counts[0] != parsed->match_count ||
+    type_counts[1] != parsed->unmatched_primary_count || type_counts[2] != parsed->unmatched_secondary_count
+  ) {
+    return std::unexpected("record counts do not match the footer");
   }
 
-  binary_differ::diff_result result;
-  auto primary_count = br.read<uint64_t>();
-  auto secondary_count = br.read<uint64_t>();
-  auto skipped_candidates = br.read<uint64_t>();
-  if (!primary_count || !secondary_count || !skipped_candidates) {
-    return std::unexpected("corrupt result counts");
-  }
-  result.primary_count = static_cast<size_t>(*primary_count);
-  result.secondary_count = static_cast<size_t>(*secondary_count);
-  result.skipped_candidates = static_cast<size_t>(*skipped_candidates);
+  auto result = std::move(parsed->totals);
+  result.matches.resize(type_counts[0]);
+  result.unmatched_primary.resize(type_counts[1]);
+  result.unmatched_secondary.resize(type_counts[2]);
+  auto decode = [&](const placement& record) -> std::expected<void, std::string> {
+    buffer_reader br(record.bytes.subspan(sizeof(record_type)));
+    if (record.type == record_type::match) {
+      auto match = read_match(br, parsed->dict);
+      if (!match) {
+        return std::unexpected(match.error());
+      }
+      result.matches[record.slot] = std::move(*match);
+    } else {
+      auto sub = subroutine_codec::read(br, parsed->dict);
+      if (!sub) {
+        return std::unexpected(sub.error());
+      }
+      auto& unmatched =
+        record.type == record_type::unmatched_primary ? result.unmatched_primary : result.unmatched_secondary;
+      unmatched[record.slot] = std::move(*sub);
+    }
+    if (br.remaining() != 0) {
+      return std::unexpected("record longer than its encoding");
+    }
+    return {};
+  };
 
-  auto match_count = br.read<uint32_t>();
-  if (!match_count) {
-    return std::unexpected("corrupt matches count");
+  constexpr size_t batch_size = 256;
+  const auto batch_count = (record_count + batch_size - 1) / batch_size;
+  const auto thread_count = std::min(
+    worker_count == 0 ? std::max(size_t{1}, size_t{std::thread::hardware_concurrency()}) : worker_count, batch_count
+  );
+  if (thread_count <= 1) {
+    for (const auto& record : placements) {
+      if (auto decoded = decode(record); !decoded) {
+        return std::unexpected(decoded.error());
+      }
+    }
+    return result;
   }
 
-  result.matches.reserve(*match_count);
-  for (uint32_t i = 0; i < *match_count; ++i) {
-    auto p = read_subroutine(br);
-    if (!p)
-      return std::unexpected(p.error());
+  std::atomic_size_t next_batch{0};
+  std::atomic_bool failed{false};
+  std::string failure;
+  std::mutex failure_mutex;
+  {
+    std::vector<std::jthread> workers;
+    workers.reserve(thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+      workers.emplace_back([&] {
+        while (!failed.load(std::memory_order_relaxed)) {
+          const auto batch = next_batch.fetch_add(1, std::memory_order_relaxed);
+          if (batch >= batch_count) {
+            break;
+          }
+          const auto end = std::min(record_count, (batch + 1) * batch_size);
+          for (auto index = batch * batch_size; index < end; ++index) {
+            if (auto decoded = decode(placements[index]); !decoded) {
+              const std::scoped_lock lock(failure_mutex);
+              if (!failed.exchange(true)) {
+                failure = decoded.error();
+              }
+              return;
+            }
+          }
+        }
+      });
+    }
+  }
+  if (failed) {
+    return std::unexpected(failure);
+  }
+  return result;
+}
 
-    auto s = read_subroutine(br);
-    if (!s)
-      return std::unexpected(s.error());
+auto diff_serializer::lookup(const std::string& filepath, uint64_t address, side which)
+  -> std::expected<binary_differ::diff_result, std::string> {
+  auto mapping = file_mapping::open(filepath);
+  if (!mapping) {
+    return std::unexpected(mapping.error());
+  }
+  const auto bytes = mapping->data();
+  if (diff_view::is_table(bytes)) {
+    return std::unexpected("table files carry no address index");
+  }
 
-    auto change = br.read<binary_differ::change_type>();
-    auto similarity = br.read<double>();
-    if (!change || !similarity) {
-      return std::unexpected("corrupt match metadata");
-    }
-    if (
-      *change > binary_differ::change_type::instructions_changed || !std::isfinite(*similarity) || *similarity < 0.0 ||
-      *similarity > 1.0
-    ) {
-      return std::unexpected("invalid match metadata");
+  auto parsed = read_footer(bytes);
+  if (!parsed) {
+    return std::unexpected(parsed.error());
+  }
+  auto result = std::move(parsed->totals);
+
+  // subroutines on one side never overlap, so the last entry starting at or before address is the only candidate
+  const auto index = which == side::primary ? parsed->primary_index : parsed->secondary_index;
+  auto entry_at = [&](size_t i) {
+    diff_writer::index_entry entry{};
+    std::memcpy(&entry, index.data() + i * sizeof(entry), sizeof(entry));
+    return entry;
+  };
+  size_t low = 0;
+  size_t high = index.size() / sizeof(diff_writer::index_entry);
+  while (low < high) {
+    const auto middle = low + (high - low) / 2;
+    if (entry_at(middle).start_address <= address) {
+      low = middle + 1;
+    } else {
+      high = middle;
     }
-    result.matches.push_back({
-      .primary = std::move(*p),
-      .secondary = std::move(*s),
-      .change = *change,
-      .similarity = *similarity,
-    });
+  }
+  if (low == 0) {
+    return result;
+  }
+  const auto entry = entry_at(low - 1);
+  if (address != entry.start_address && address >= entry.end_address) {
+    return result;
   }
 
-  auto up_count = br.read<uint32_t>();
-  if (!up_count) {
-    return std::unexpected("corrupt unmatched primary count");
+  const auto record_count = parsed->record_offsets.size() / sizeof(uint64_t);
+  if (entry.record >= record_count) {
+    return std::unexpected("corrupt address index");
+  }
+  uint64_t offset{};
+  std::memcpy(&offset, parsed->record_offsets.data() + entry.record * sizeof(offset), sizeof(offset));
+  const auto records_start = static_cast<uint64_t>(parsed->records.data() - bytes.data());
+  if (offset < records_start || offset >= records_start + parsed->records.size()) {
+    return std::unexpected("corrupt record offset");
   }
 
-  result.unmatched_primary.reserve(*up_count);
-  for (uint32_t i = 0; i < *up_count; ++i) {
-    auto sub = read_subroutine(br);
-    if (!sub)
-      return std::unexpected(sub.error());
-    result.unmatched_primary.push_back(std::move(*sub));
+  buffer_reader br(parsed->records.subspan(static_cast<size_t>(offset - records_start)));
+  if (auto read = read_record(br, parsed->dict, result); !read) {
+    return std::unexpected(read.error());
   }
+  return result;
+}
 
-  auto us_count = br.read<uint32_t>();
-  if (!us_count) {
-    return std::unexpected("corrupt unmatched secondary count");
+diff_writer::diff_writer(std::ofstream stream) : stream_(std::move(stream)) {
+  chunk_.write(format_magic);
+  chunk_.write(format_version);
+}
+
+auto diff_writer::open(const std::string& filepath) -> std::expected<diff_writer, std::string> {
+  std::ofstream os(filepath, std::ios::binary);
+  if (!os) {
+    return std::unexpected("failed to open file");
   }
+  return diff_writer(std::move(os));
+}
 
-  result.unmatched_secondary.reserve(*us_count);
-  for (uint32_t i = 0; i < *us_count; ++i) {
-    auto sub = read_subroutine(br);
-    if (!sub)
-      return std::unexpected(sub.error());
-    result.unmatched_secondary.push_back(std::move(*sub));
+void diff_writer::add_match(const binary_differ::matched_subroutine& match) {
+  begin_record();
+  primary_index_.push_back({match.primary.start_address, match.primary.end_address, record_offsets_.size() - 1});
+  secondary_index_.push_back({match.secondary.start_address, match.secondary.end_address, record_offsets_.size() - 1});
+  chunk_.write(record_type::match);
+  subroutine_codec::write(chunk_, match.primary, dict_);
+  subroutine_codec::write(chunk_, match.secondary, dict_);
+  chunk_.write(match.change);
+  chunk_.write(match.similarity);
+  ++match_count_;
+  end_record();
+}
+
+void diff_writer::add_unmatched_primary(const subroutine_analyzer::subroutine& sub) {
+  begin_record();
+  primary_index_.push_back({sub.start_address, sub.end_address, record_offsets_.size() - 1});
+  chunk_.write(record_type::unmatched_primary);
+  subroutine_codec::write(chunk_, sub, dict_);
+  ++unmatched_primary_count_;
+  end_record();
+}
+
+void diff_writer::add_unmatched_secondary(const subroutine_analyzer::subroutine& sub) {
+  begin_record();
+  secondary_index_.push_back({sub.start_address, sub.end_address, record_offsets_.size() - 1});
+  chunk_.write(record_type::unmatched_secondary);
+  subroutine_codec::write(chunk_, sub, dict_);
+  ++unmatched_secondary_count_;
+  end_record();
+}
+
+auto diff_writer::sink() -> binary_differ::result_sink {
+  return {
+    .match = [this](binary_differ::matched_subroutine&& match) {
+      add_match(match);
+    },
+    .unmatched_primary = [this](subroutine_analyzer::subroutine&& sub) {
+      add_unmatched_primary(sub);
+    },
+    .unmatched_secondary = [this](subroutine_analyzer::subroutine&& sub) {
+      add_unmatched_secondary(sub);
+    },
+  };
+}
+
+auto diff_writer::finish(const summary& totals) -> bool {
+  const auto footer_offset = flushed_ + chunk_.size();
+  chunk_.write(static_cast<uint64_t>(totals.primary_count));
+  chunk_.write(static_cast<uint64_t>(totals.secondary_count));
+  chunk_.write(static_cast<uint64_t>(totals.skipped_candidates));
+  chunk_.write(static_cast<uint64_t>(totals.prefiltered_candidates));
+  chunk_.write(match_count_);
+  chunk_.write(unmatched_primary_count_);
+  chunk_.write(unmatched_secondary_count_);
+  dict_.write(chunk_);
+
+  auto by_address = [](const index_entry& lhs, const index_entry& rhs) {
+    return lhs.start_address != rhs.start_address ? lhs.start_address < rhs.start_address : lhs.record < rhs.record;
+  };
+  std::ranges::sort(primary_index_, by_address);
+  std::ranges::sort(secondary_index_, by_address);
+  chunk_.write(static_cast<uint64_t>(record_offsets_.size()));
+  chunk_.write_span(std::span<const uint64_t>(record_offsets_));
+  chunk_.write(static_cast<uint64_t>(primary_index_.size()));
+  chunk_.write_span(std::span<const index_entry>(primary_index_));
+  chunk_.write(static_cast<uint64_t>(secondary_index_.size()));
+  chunk_.write_span(std::span<const index_entry>(secondary_index_));
+  chunk_.write(footer_offset);
+  chunk_.write(format_magic);
+  flush();
+  stream_.flush();
+  return stream_.good();
+}
+
+void diff_writer::begin_record() {
+  record_offsets_.push_back(flushed_ + chunk_.size());
+}
+
+void diff_writer::end_record() {
+  if (chunk_.size() >= chunk_size) {
+    flush();
   }
+}
 
-  return result;
+void diff_writer::flush() {
+  const auto bytes = chunk_.data();
+  stream_.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+  flushed_ += bytes.size();
+  chunk_.clear();
 }
@@ -1,11 +1,77 @@
 #pragma once
 
+#include <cstdint>
 #include <expected>
+#include <fstream>
 #include <string>
+#include <vector>
+#include "buffer.h"
+#include "codec.h"
 #include "differ.h"
 
 class diff_serializer {
   public:
+  enum class side : uint8_t {
+    primary,
+    secondary,
+  };
+
   [[nodiscard]] static auto save(const binary_differ::diff_result& result, const std::string& filepath) -> bool;
-  [[nodiscard]] static auto load(const std::string& filepath) -> std::expected<binary_differ::diff_result, std::string>;
+  // also accepts files written by diff_view::save. records are decoded on worker_count threads through the record
+  // offset table, zero uses every hardware thread
+  [[nodiscard]] static auto load(const std::string& filepath, size_t worker_count = 0)
+    -> std::expected<binary_differ::diff_result, std::string>;
+  // maps the file and decodes only the record whose subroutine on that side covers address, through the address
+  // index in the footer. the result carries the file's counts and is otherwise empty when nothing covers it
+  [[nodiscard]] static auto lookup(const std::string& filepath, uint64_t address, side which)
+    -> std::expected<binary_differ::diff_result, std::string>;
+};
+
+// writes a diff one record at a time, flushing a chunk whenever it fills up. the counts and the dictionary the
+// records refer to follow them in a footer, so nothing has to be known up front
+class diff_writer {
+  public:
+  struct summary {
+    size_t primary_count{0};
+    size_t secondary_count{0};
+    size_t skipped_candidates{0};
+    size_t prefiltered_candidates{0};
+  };
+
+  static constexpr size_t chunk_size = 1 << 20;
+
+  // one row of a footer address index, rows are sorted by start address
+  struct index_entry {
+    uint64_t start_address;
+    uint64_t end_address;
+    uint64_t record;
+  };
+
+  [[nodiscard]] static auto open(const std::string& filepath) -> std::expected<diff_writer, std::string>;
+
+  void add_match(const binary_differ::matched_subroutine& match);
+  void add_unmatched_primary(const subroutine_analyzer::subroutine& sub);
+  void add_unmatched_secondary(const subroutine_analyzer::subroutine& sub);
+  // for binary_differ::compare, the writer must stay in place while the sink is in use
+  [[nodiscard]] auto sink() -> binary_differ::result_sink;
+  [[nodiscard]] auto finish(const summary& totals) -> bool;
+
+  private:
+  explicit diff_writer(std::ofstream stream);
+
+  void begin_record();
+  void end_record();
+  void flush();
+
+  std::ofstream stream_;
+  buffer_writer chunk_;
+  subroutine_codec::dictionary_builder dict_;
+  uint64_t flushed_{0};
+  uint64_t match_count_{0};
+  uint64_t unmatched_primary_count_{0};
+  uint64_t unmatched_secondary_count_{0};
+  // file offset of every record in write order
+  std::vector<uint64_t> record_offsets_;
+  std::vector<index_entry> primary_index_;
+  std::vector<index_entry> secondary_index_;
 };
@@ -1,9 +1,11 @@
 #include "core/strings.h"
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cstring>
 #include <optional>
+#include <span>
 #include <string_view>
-#include <unordered_map>
 #include <unordered_set>
 #include "decoder.h"
 #include "headers/elf_header.h"
@@ -34,19 +36,110 @@ namespace {
     return value == '\t' || (value >= 0x20 && value <= 0x7e);
   }
 
-  [[nodiscard]] auto read_u32(const uint8_t* data) -> uint32_t {
-    uint32_t value{};
-    std::memcpy(&value, data, sizeof(value));
-    return value;
-  }
-
   [[nodiscard]] auto read_u64(const uint8_t* data) -> uint64_t {
     uint64_t value{};
     std::memcpy(&value, data, sizeof(value));
     return value;
   }
 
-  [[nodiscard]] auto extract_strings(const binary_parser& parser, size_t min_length) -> std::vector<strings::entry> {
+  constexpr uint64_t byte_lanes = 0x0101010101010101;
+  constexpr uint64_t high_bits = 0x8080808080808080;
+
+  // sets the high bit of every byte lane that passes is_string_byte. lanes are compared with their own high bit
+  // cleared, so none of the additions can carry into the next lane
+  [[nodiscard]] auto string_byte_mask(uint64_t word) -> uint64_t {
+    const auto low = word & ~high_bits;
+    const auto at_least_space = (low + byte_lanes * (0x80 - 0x20)) & high_bits;
+    const auto is_delete = (low + byte_lanes) & high_bits;
+    const auto not_tab = ((low ^ (byte_lanes * '\t')) + byte_lanes * 0x7f) & high_bits;
+    return ((at_least_space & ~is_delete) | (~not_tab & high_bits)) & ~word;
+  }
+
+  // sets the high bit of every byte lane that is zero
+  [[nodiscard]] auto zero_byte_mask(uint64_t word) -> uint64_t {
+    return ~(((word & ~high_bits) + ~high_bits) | word) & high_bits;
+  }
+
+  constexpr size_t block_size = 64;
+
+  // classifies the 64 positions at data into bit i for position i. the multiply gathers the lane high bits of each
+  // word into one byte
+  [[nodiscard]] auto gather_block(const uint8_t* data, const auto& word_mask) -> uint64_t {
+    constexpr uint64_t gather = 0x0102040810204080;
+    uint64_t bits = 0;
+    for (size_t word = 0; word < block_size / sizeof(uint64_t); ++word) {
+      const auto mask = word_mask(data + word * sizeof(uint64_t)) >> 7;
+      bits |= ((mask * gather) >> 56) << (word * 8);
+    }
+    return bits;
+  }
+
+  // ascii positions are string bytes
+  [[nodiscard]] auto ascii_bits(std::span<const uint8_t> data, size_t base) -> uint64_t {
+    if (base + block_size <= data.size()) {
+      return gather_block(data.data() + base, [](const uint8_t* word) {
+        return string_byte_mask(read_u64(word));
+      });
+    }
+    uint64_t bits = 0;
+    for (size_t i = base; i < data.size(); ++i) {
+      bits |= static_cast<uint64_t>(is_string_byte(data[i])) << (i - base);
+    }
+    return bits;
+  }
+
+  // utf-16le positions are a string byte followed by a zero high byte, so each word is checked against the same
+  // word read one byte later
+  [[nodiscard]] auto wide_bits(std::span<const uint8_t> data, size_t base) -> uint64_t {
+    if (base + block_size < data.size()) {
+      return gather_block(data.data() + base, [](const uint8_t* word) {
+        return string_byte_mask(read_u64(word)) & zero_byte_mask(read_u64(word + 1));
+      });
+    }
+    uint64_t bits = 0;
+    for (size_t i = base; i + 1 < data.size() && i < base + block_size; ++i) {
+      bits |= static_cast<uint64_t>(is_string_byte(data[i]) && data[i + 1] == 0) << (i - base);
+    }
+    return bits;
+  }
+
+  // calls on_run(start, end) for every maximal run of positions stride bytes apart whose bits are set, end being the
+  // first position after the run. runs start and end where a block's bits differ from the same bits shifted by one
+  // stride, so each run costs a couple of bit operations however long it is. with a stride of two, odd and even
+  // positions are separate runs
+  void for_each_run(size_t size, size_t stride, const auto& block_bits, const auto& on_run) {
+    constexpr std::array<uint64_t, 2> phase_masks{0x5555555555555555, 0xaaaaaaaaaaaaaaaa};
+    std::array<bool, 2> in_run{};
+    std::array<size_t, 2> run_start{};
+
+    size_t base = 0;
+    for (; base < size; base += block_size) {
+      const auto bits = block_bits(base);
+      for (size_t phase = 0; phase < stride; ++phase) {
+        const auto phase_bits = stride == 1 ? bits : bits & phase_masks[phase];
+        auto edges = phase_bits ^ ((phase_bits << stride) | (static_cast<uint64_t>(in_run[phase]) << phase));
+        while (edges != 0) {
+          const auto position = base + static_cast<size_t>(std::countr_zero(edges));
+          edges &= edges - 1;
+          if (in_run[phase]) {
+            on_run(run_start[phase], position);
+          } else {
+            run_start[phase] = position;
+          }
+          in_run[phase] = !in_run[phase];
+        }
+      }
+    }
+
+    for (size_t phase = 0; phase < stride; ++phase) {
+      if (in_run[phase]) {
+        on_run(run_start[phase], base + phase);
+      }
+    }
+  }
+
+  [[nodiscard]] auto extract_strings(const binary_parser& parser, const strings::options& opts)
+    -> std::vector<strings::entry> {
     std::vector<strings::entry> strings;
 
     for (const auto& section : parser.get_sections()) {
@@ -54,55 +147,87 @@ namespace {
         continue;
       }
 
-      size_t start = 0;
-      while (start < section.data.size()) {
-        while (start < section.data.size() && !is_string_byte(section.data[start])) {
-          ++start;
-        }
-
-        auto end = start;
-        while (end < section.data.size() && is_string_byte(section.data[end])) {
-          ++end;
-        }
-
-        if (end - start >= min_length && end < section.data.size() && section.data[end] == 0) {
-          strings.push_back({
-            .address = section.virtual_address + start,
-            .section = section.name,
-            .value = std::string(reinterpret_cast<const char*>(section.data.data() + start), end - start),
-            .xrefs = {},
-          });
-        }
-
-        start = end + 1;
+      for (auto& entry : strings::scan(section.data, opts)) {
+        entry.address += section.virtual_address;
+        entry.section = section.name;
+        strings.push_back(std::move(entry));
       }
     }
 
     return strings;
   }
 
-  [[nodiscard]] auto resolve_address(const binary_parser::section& text, size_t match_offset)
-    -> std::optional<uint64_t> {
-    const auto search_begin = match_offset > 15 ? match_offset - 15 : 0;
+  struct xref {
+    uint64_t target;
+    uint64_t instruction;
+  };
+
+  // absolute operands hold virtual addresses while pe sections are image relative, values below the image base
+  // cannot point into it
+  [[nodiscard]] auto rebase(uint64_t value, uint64_t image_base) -> std::optional<uint64_t> {
+    if (value < image_base) {
+      return std::nullopt;
+    }
+    return value - image_base;
+  }
+
+  // linear sweep of the text section, recording what rip relative and absolute memory operands and absolute
+  // immediates point at. targets outside [lowest, highest] are dropped and an undecodable byte is skipped. data in
+  // the section can put the sweep out of step, so an instruction running over a known function start is dropped and
+  // the sweep restarts at that start. the result is ordered by target, then by instruction address
+  [[nodiscard]] auto collect_xrefs(
+    const binary_parser::section& text, std::span<const uint64_t> function_starts, uint64_t image_base,
+    uint64_t lowest, uint64_t highest
+  ) -> std::vector<xref> {
     decoder code_decoder;
+    std::vector<xref> xrefs;
+
+    auto next_start = function_starts.begin();
+    size_t offset = 0;
+    while (offset < text.data.size()) {
+      const auto address = text.virtual_address + offset;
+      while (next_start != function_starts.end() && *next_start <= address) {
+        ++next_start;
+      }
+      if (!code_decoder.disassemble(address, text.data.data() + offset, text.data.size() - offset)) {
+        ++offset;
+        continue;
+      }
+
+      const auto& instruction = code_decoder.get_decoded_instruction();
+      if (next_start != function_starts.end() && *next_start < address + instruction.length) {
+        offset = *next_start - text.virtual_address;
+        continue;
+      }
+      const auto* operands = code_decoder.get_decoded_operands();
+      for (uint8_t i = 0; i < instruction.operand_count; ++i) {
+        const auto& operand = operands[i];
+        if (operand.visibility == ZYDIS_OPERAND_VISIBILITY_HIDDEN) {
+          continue;
+        }
 
-    for (size_t candidate = search_begin; candidate <= match_offset; ++candidate) {
-      size_t offset = candidate;
-      while (offset <= match_offset) {
-        const auto address = text.virtual_address + offset;
-        if (!code_decoder.disassemble(address, text.data.data() + offset, text.data.size() - offset)) {
-          break;
+        std::optional<uint64_t> target;
+        if (operand.type == ZYDIS_OPERAND_TYPE_MEMORY) {
+          const auto displacement = static_cast<uint64_t>(operand.mem.disp.value);
+          if (operand.mem.base == ZYDIS_REGISTER_RIP || operand.mem.base == ZYDIS_REGISTER_EIP) {
+            target = address + instruction.length + displacement;
+          } else if (operand.mem.base == ZYDIS_REGISTER_NONE && operand.mem.index == ZYDIS_REGISTER_NONE) {
+            target = rebase(displacement, image_base);
+          }
+        } else if (operand.type == ZYDIS_OPERAND_TYPE_IMMEDIATE && !operand.imm.is_relative) {
+          target = rebase(operand.imm.value.u, image_base);
         }
 
-        const auto instruction = code_decoder.get_decoded_instruction();
-        if (match_offset < offset + instruction.length) {
-          return address;
+        if (target && *target >= lowest && *target <= highest) {
+          xrefs.push_back({.target = *target, .instruction = address});
         }
-        offset += instruction.length;
       }
+      offset += instruction.length;
     }
 
-    return std::nullopt;
+    // the sweep already visits instructions in address order
+    std::ranges::stable_sort(xrefs, {}, &xref::target);
+    return xrefs;
   }
 
   void attach_xrefs(const binary_parser& parser, std::vector<strings::entry>& strings, size_t reference_limit) {
@@ -111,66 +236,36 @@ namespace {
       return;
     }
 
-    std::unordered_map<uint64_t, std::vector<size_t>> strings_by_address;
-    strings_by_address.reserve(strings.size());
-    for (size_t i = 0; i < strings.size(); ++i) {
-      strings_by_address[strings[i].address].push_back(i);
-    }
-
-    std::unordered_map<size_t, uint64_t> address_cache;
-
-    auto get_address = [&](size_t match_offset) {
-      auto it = address_cache.find(match_offset);
-      if (it != address_cache.end()) {
-        return it->second;
-      }
-
-      const auto resolved = resolve_address(*text, match_offset).value_or(text->virtual_address + match_offset);
-      address_cache.emplace(match_offset, resolved);
-      return resolved;
-    };
-
-    auto add_xref = [&](uint64_t target, size_t match_offset) {
-      auto it = strings_by_address.find(target);
-      if (it == strings_by_address.end()) {
-        return;
-      }
-      const auto xref_address = get_address(match_offset);
-      for (auto string_index : it->second) {
-        auto& xrefs = strings[string_index].xrefs;
-        if (xrefs.size() < reference_limit && !std::ranges::contains(xrefs, xref_address)) {
-          xrefs.push_back(xref_address);
+    const auto [lowest, highest] = std::ranges::minmax(strings, {}, &strings::entry::address);
+    const auto xrefs = collect_xrefs(
+      *text, parser.get_function_starts(), parser.get_image_base(), lowest.address, highest.address
+    );
+    for (auto& entry : strings) {
+      const auto [first, last] = std::ranges::equal_range(xrefs, entry.address, {}, &xref::target);
+      for (auto it = first; it != last && entry.xrefs.size() < reference_limit; ++it) {
+        if (entry.xrefs.empty() || entry.xrefs.back() != it->instruction) {
+          entry.xrefs.push_back(it->instruction);
         }
       }
-    };
-
-    for (size_t offset = 0; offset < text->data.size(); ++offset) {
-      if (offset + sizeof(uint32_t) <= text->data.size()) {
-        add_xref(read_u32(text->data.data() + offset), offset);
-      }
-      if (offset + sizeof(uint64_t) <= text->data.size()) {
-        add_xref(read_u64(text->data.data() + offset), offset);
-      }
     }
   }
 
   [[nodiscard]] auto diff_strings(const std::vector<strings::entry>& source, const std::vector<strings::entry>& other)
     -> std::vector<strings::entry> {
-    std::unordered_set<std::string_view> other_values;
-    other_values.reserve(other.size());
+    // ascii and wide strings are compared separately, re-encoding a string counts as a change
+    std::array<std::unordered_set<std::string_view>, 2> other_values;
     for (const auto& entry : other) {
-      other_values.insert(entry.value);
+      other_values[entry.wide].insert(entry.value);
     }
 
     std::vector<strings::entry> result;
-    std::unordered_set<std::string_view> emitted_values;
-    emitted_values.reserve(source.size());
+    std::array<std::unordered_set<std::string_view>, 2> emitted_values;
     for (const auto& entry : source) {
-      if (other_values.contains(entry.value) || emitted_values.contains(entry.value)) {
+      if (other_values[entry.wide].contains(entry.value) || emitted_values[entry.wide].contains(entry.value)) {
         continue;
       }
       result.push_back(entry);
-      emitted_values.insert(entry.value);
+      emitted_values[entry.wide].insert(entry.value);
     }
 
     std::ranges::sort(result, [](const auto& lhs, const auto& rhs) {
@@ -186,12 +281,54 @@ namespace {
 
 } // namespace
 
+auto strings::scan(std::span<const uint8_t> data, const options& opts) -> std::vector<entry> {
+  std::vector<entry> found;
+  auto add_string = [&](size_t start, std::string value, bool wide) {
+    found.push_back({
+      .address = start,
+      .section = {},
+      .value = std::move(value),
+      .xrefs = {},
+      .wide = wide,
+    });
+  };
+
+  auto ascii_block = [&](size_t base) {
+    return ascii_bits(data, base);
+  };
+  for_each_run(data.size(), 1, ascii_block, [&](size_t start, size_t end) {
+    if (end - start >= opts.min_length && end < data.size() && data[end] == 0) {
+      add_string(start, std::string(reinterpret_cast<const char*>(data.data() + start), end - start), false);
+    }
+  });
+
+  if (!opts.wide) {
+    return found;
+  }
+  // wide runs are kept when they end in a utf-16 nul, the value holds the low bytes
+  auto wide_block = [&](size_t base) {
+    return wide_bits(data, base);
+  };
+  for_each_run(data.size(), 2, wide_block, [&](size_t start, size_t end) {
+    if ((end - start) / 2 >= opts.min_length && end + 1 < data.size() && data[end] == 0 && data[end + 1] == 0) {
+      std::string value((end - start) / 2, '\0');
+      for (size_t i = 0; i < value.size(); ++i) {
+        value[i] = static_cast<char>(data[start + i * 2]);
+      }
+      add_string(start, std::move(value), true);
+    }
+  });
+  // wide strings were found in a second pass, keep the entries in address order
+  std::ranges::stable_sort(found, {}, &entry::address);
+  return found;
+}
+
 strings::result strings::compare(const std::string& primary_path, const std::string& secondary_path, options opts) {
   binary_parser primary(primary_path);
   binary_parser secondary(secondary_path);
 
-  auto primary_strings = extract_strings(primary, opts.min_length);
-  auto secondary_strings = extract_strings(secondary, opts.min_length);
+  auto primary_strings = extract_strings(primary, opts);
+  auto secondary_strings = extract_strings(secondary, opts);
   attach_xrefs(primary, primary_strings, opts.reference_limit);
   attach_xrefs(secondary, secondary_strings, opts.reference_limit);
 
@@ -2,6 +2,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -10,6 +11,8 @@ class strings {
   struct options {
     size_t min_length{4};
     size_t reference_limit{8};
+    // also extract utf-16le strings whose characters all fit in one byte
+    bool wide{true};
   };
 
   struct entry {
@@ -17,6 +20,8 @@ class strings {
     std::string section;
     std::string value;
     std::vector<uint64_t> xrefs;
+    // value was stored as utf-16le, it holds the low byte of every character
+    bool wide{false};
   };
 
   struct result {
@@ -26,5 +31,7 @@ class strings {
     std::vector<entry> removed;
   };
 
+  // the strings in one section's bytes in address order. addresses are offsets into data and section is left empty
+  [[nodiscard]] static auto scan(std::span<const uint8_t> data, const options& opts) -> std::vector<entry>;
   [[nodiscard]] static result compare(const std::string& primary_path, const std::string& secondary_path, options opts);
 };
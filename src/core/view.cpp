@@ -0,0 +1,309 @@
+#include "view.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "buffer.h"
+
+namespace {
+
+  constexpr uint32_t table_magic = 0x5a594454; // zydt
+  constexpr uint32_t table_version = 1;
+  constexpr size_t table_alignment = alignof(uint64_t);
+
+  [[nodiscard]] auto align_offset(uint64_t offset) -> uint64_t {
+    return (offset + table_alignment - 1) / table_alignment * table_alignment;
+  }
+
+} // namespace
+
+auto diff_view::save(const binary_differ::diff_result& result, const std::string& filepath) -> bool {
+  static_assert(sizeof(match_record) == 24 && sizeof(subroutine_record) == 184 && sizeof(block_record) == 88);
+
+  std::vector<match_record> matches;
+  std::vector<uint32_t> unmatched_primary;
+  std::vector<uint32_t> unmatched_secondary;
+  std::vector<subroutine_record> subroutines;
+  std::vector<block_record> blocks;
+  std::vector<uint64_t> words;
+  std::vector<int64_t> successors;
+  std::vector<uint32_t> sketches;
+  std::vector<string_record> strings;
+  std::string text;
+
+  auto append_words = [&](std::span<const uint64_t> values) -> slice {
+    const slice range{.first = words.size(), .count = values.size()};
+    words.insert(words.end(), values.begin(), values.end());
+    return range;
+  };
+  auto add_subroutine = [&](const subroutine_analyzer::subroutine& sub) -> uint32_t {
+    subroutine_record record{
+      .start_address = sub.start_address,
+      .end_address = sub.end_address,
+      .fingerprint = static_cast<uint64_t>(sub.fingerprint),
+      .byte_size = sub.byte_size,
+      .instruction_count = sub.instruction_count,
+      .instruction_hash = sub.instruction_hash,
+      .graph_hash = sub.graph_hash,
+      .range_hash = sub.range_hash,
+      .byte_hash = sub.byte_hash,
+      .sketch = {.first = sketches.size(), .count = sub.sketch.size()},
+      .call_targets = append_words(sub.call_targets),
+      .data_refs = append_words(sub.data_refs),
+      .constants = append_words(sub.constants),
+      .blocks = {.first = blocks.size(), .count = sub.basic_blocks.size()},
+      .features = sub.features,
+    };
+    sketches.insert(sketches.end(), sub.sketch.begin(), sub.sketch.end());
+
+    for (const auto& bb : sub.basic_blocks) {
+      blocks.push_back({
+        .start_address = bb.start_address,
+        .end_address = bb.end_address,
+        .match_hash = bb.match_hash,
+        .successor_keys = {.first = successors.size(), .count = bb.successor_keys.size()},
+        .instruction_keys = append_words(bb.instruction_keys),
+        .match_keys = append_words(bb.match_keys),
+        .instructions = {.first = strings.size(), .count = bb.instructions.size()},
+      });
+      successors.insert(successors.end(), bb.successor_keys.begin(), bb.successor_keys.end());
+      for (const auto& instruction : bb.instructions) {
+        strings.push_back({.offset = text.size(), .length = instruction.size()});
+        text += instruction;
+      }
+    }
+
+    subroutines.push_back(record);
+    return static_cast<uint32_t>(subroutines.size() - 1);
+  };
+
+  for (const auto& match : result.matches) {
+    match_record record{};
+    record.primary = add_subroutine(match.primary);
+    record.secondary = add_subroutine(match.secondary);
+    record.similarity = match.similarity;
+    record.change = match.change;
+    matches.push_back(record);
+  }
+  for (const auto& sub : result.unmatched_primary) {
+    unmatched_primary.push_back(add_subroutine(sub));
+  }
+  for (const auto& sub : result.unmatched_secondary) {
+    unmatched_secondary.push_back(add_subroutine(sub));
+  }
+
+  // every table starts on an 8 byte boundary after the header, in header order
+  header file_header{
+    .magic = table_magic,
+    .version = table_version,
+    .primary_count = result.primary_count,
+    .secondary_count = result.secondary_count,
+    .skipped_candidates = result.skipped_candidates,
+    .prefiltered_candidates = result.prefiltered_candidates,
+  };
+  uint64_t offset = sizeof(header);
+  auto place = [&](table& entry, size_t count, size_t element_size) {
+    offset = align_offset(offset);
+    entry = {.offset = offset, .count = count};
+    offset += count * element_size;
+  };
+  place(file_header.matches, matches.size(), sizeof(match_record));
+  place(file_header.unmatched_primary, unmatched_primary.size(), sizeof(uint32_t));
+  place(file_header.unmatched_secondary, unmatched_secondary.size(), sizeof(uint32_t));
+  place(file_header.subroutines, subroutines.size(), sizeof(subroutine_record));
+  place(file_header.blocks, blocks.size(), sizeof(block_record));
+  place(file_header.words, words.size(), sizeof(uint64_t));
+  place(file_header.successors, successors.size(), sizeof(int64_t));
+  place(file_header.sketches, sketches.size(), sizeof(uint32_t));
+  place(file_header.strings, strings.size(), sizeof(string_record));
+  place(file_header.text, text.size(), sizeof(char));
+
+  buffer_writer bw;
+  bw.write(file_header);
+  auto write_table = [&]<typename T>(const std::vector<T>& values) {
+    bw.align(table_alignment);
+    bw.write_span(std::span<const T>(values));
+  };
+  write_table(matches);
+  write_table(unmatched_primary);
+  write_table(unmatched_secondary);
+  write_table(subroutines);
+  write_table(blocks);
+  write_table(words);
+  write_table(successors);
+  write_table(sketches);
+  write_table(strings);
+  bw.align(table_alignment);
+  bw.write_span(std::span<const char>(text));
+  return bw.save_to_file(filepath);
+}
+
+auto diff_view::open(const std::string& filepath) -> std::expected<diff_view, std::string> {
+  auto mapping = file_mapping::open(filepath);
+  if (!mapping) {
+    return std::unexpected(mapping.error());
+  }
+
+  diff_view view(std::move(*mapping));
+  const auto bytes = view.mapping_.data();
+  if (bytes.size() < sizeof(header)) {
+    return std::unexpected("file too small to contain valid header");
+  }
+
+  view.header_ = reinterpret_cast<const header*>(bytes.data());
+  if (view.header_->magic != table_magic) {
+    return std::unexpected("invalid file magic");
+  }
+  if (view.header_->version != table_version) {
+    return std::unexpected("unsupported format version");
+  }
+
+  auto bind = [&]<typename T>(const table& entry, std::span<const T>& target) {
+    if (
+      entry.offset % table_alignment != 0 || entry.offset > bytes.size() ||
+      entry.count > (bytes.size() - entry.offset) / sizeof(T)
+    ) {
+      return false;
+    }
+    target = {reinterpret_cast<const T*>(bytes.data() + entry.offset), static_cast<size_t>(entry.count)};
+    return true;
+  };
+  const auto& file_header = *view.header_;
+  if (
+    !bind(file_header.matches, view.matches_) || !bind(file_header.unmatched_primary, view.unmatched_primary_) ||
+    !bind(file_header.unmatched_secondary, view.unmatched_secondary_) ||
+    !bind(file_header.subroutines, view.subroutines_) || !bind(file_header.blocks, view.blocks_) ||
+    !bind(file_header.words, view.words_) || !bind(file_header.successors, view.successors_) ||
+    !bind(file_header.sketches, view.sketches_) || !bind(file_header.strings, view.strings_) ||
+    !bind(file_header.text, view.text_)
+  ) {
+    return std::unexpected("corrupt table bounds");
+  }
+  if (!view.validate()) {
+    return std::unexpected("corrupt table contents");
+  }
+  return view;
+}
+
+auto diff_view::is_table(std::span<const uint8_t> prefix) -> bool {
+  uint32_t magic{};
+  if (prefix.size() < sizeof(magic)) {
+    return false;
+  }
+  std::memcpy(&magic, prefix.data(), sizeof(magic));
+  return magic == table_magic;
+}
+
+// one pass over the records without allocating, afterwards every slice and index is known to be in bounds
+auto diff_view::validate() const -> bool {
+  auto within = [](const slice& range, size_t size) {
+    return range.first <= size && range.count <= size - range.first;
+  };
+
+  for (const auto& record : matches_) {
+    if (
+      record.primary >= subroutines_.size() || record.secondary >= subroutines_.size() ||
+      record.change > binary_differ::change_type::instructions_changed || !std::isfinite(record.similarity) ||
+      record.similarity < 0.0 || record.similarity > 1.0
+    ) {
+      return false;
+    }
+  }
+  for (const auto index : unmatched_primary_) {
+    if (index >= subroutines_.size()) {
+      return false;
+    }
+  }
+  for (const auto index : unmatched_secondary_) {
+    if (index >= subroutines_.size()) {
+      return false;
+    }
+  }
+  for (const auto& record : subroutines_) {
+    if (
+      !within(record.sketch, sketches_.size()) || !within(record.call_targets, words_.size()) ||
+      !within(record.data_refs, words_.size()) || !within(record.constants, words_.size()) ||
+      !within(record.blocks, blocks_.size())
+    ) {
+      return false;
+    }
+  }
+  for (const auto& record : blocks_) {
+    if (
+      !within(record.successor_keys, successors_.size()) || !within(record.instruction_keys, words_.size()) ||
+      !within(record.match_keys, words_.size()) || !within(record.instructions, strings_.size())
+    ) {
+      return false;
+    }
+  }
+  for (const auto& record : strings_) {
+    if (!within({.first = record.offset, .count = record.length}, text_.size())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+auto diff_view::subroutine_view::materialize() const -> subroutine_analyzer::subroutine {
+  subroutine_analyzer::subroutine sub{
+    .start_address = start_address(),
+    .end_address = end_address(),
+    .basic_blocks = {},
+    .fingerprint = code_fingerprint(),
+    .byte_size = byte_size(),
+    .instruction_count = instruction_count(),
+    .instruction_hash = instruction_hash(),
+    .graph_hash = graph_hash(),
+    .range_hash = range_hash(),
+    .byte_hash = byte_hash(),
+    .sketch = {sketch().begin(), sketch().end()},
+    .call_targets = {call_targets().begin(), call_targets().end()},
+    .data_refs = {data_refs().begin(), data_refs().end()},
+    .constants = {constants().begin(), constants().end()},
+    .features = features(),
+  };
+
+  sub.basic_blocks.reserve(block_count());
+  for (size_t i = 0; i < block_count(); ++i) {
+    const auto view = block(i);
+    auto& bb = sub.basic_blocks.emplace_back();
+    bb.start_address = view.start_address();
+    bb.end_address = view.end_address();
+    bb.successor_keys.assign(view.successor_keys().begin(), view.successor_keys().end());
+    bb.instruction_keys.assign(view.instruction_keys().begin(), view.instruction_keys().end());
+    bb.match_keys.assign(view.match_keys().begin(), view.match_keys().end());
+    bb.match_hash = view.match_hash();
+    bb.instructions.reserve(view.instruction_count());
+    for (size_t j = 0; j < view.instruction_count(); ++j) {
+      bb.instructions.emplace_back(view.instruction(j));
+    }
+  }
+  return sub;
+}
+
+auto diff_view::materialize() const -> binary_differ::diff_result {
+  binary_differ::diff_result result;
+  result.primary_count = primary_count();
+  result.secondary_count = secondary_count();
+  result.skipped_candidates = skipped_candidates();
+  result.prefiltered_candidates = prefiltered_candidates();
+
+  result.matches.reserve(match_count());
+  for (size_t i = 0; i < match_count(); ++i) {
+    const auto view = match(i);
+    result.matches.push_back({
+      .primary = view.primary().materialize(),
+      .secondary = view.secondary().materialize(),
+      .change = view.change(),
+      .similarity = view.similarity(),
+    });
+  }
+  result.unmatched_primary.reserve(unmatched_primary_count());
+  for (size_t i = 0; i < unmatched_primary_count(); ++i) {
+    result.unmatched_primary.push_back(unmatched_primary(i).materialize());
+  }
+  result.unmatched_secondary.reserve(unmatched_secondary_count());
+  for (size_t i = 0; i < unmatched_secondary_count(); ++i) {
+    result.unmatched_secondary.push_back(unmatched_secondary(i).materialize());
+  }
+  return result;
+}
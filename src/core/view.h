@@ -0,0 +1,281 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "differ.h"
+#include "mapping.h"
+
+// fixed width, offset indexed diff tables served straight from a file mapping. every table is 8 byte aligned and
+// indices are checked once in open, so the accessors never allocate or fail
+class diff_view {
+  private:
+  struct table {
+    uint64_t offset;
+    uint64_t count;
+  };
+
+  struct slice {
+    uint64_t first;
+    uint64_t count;
+  };
+
+  struct header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t primary_count;
+    uint64_t secondary_count;
+    uint64_t skipped_candidates;
+    uint64_t prefiltered_candidates;
+    table matches{};
+    table unmatched_primary{};
+    table unmatched_secondary{};
+    table subroutines{};
+    table blocks{};
+    table words{};
+    table successors{};
+    table sketches{};
+    table strings{};
+    table text{};
+  };
+
+  struct match_record {
+    uint32_t primary;
+    uint32_t secondary;
+    double similarity;
+    binary_differ::change_type change;
+    uint8_t padding[7];
+  };
+
+  struct subroutine_record {
+    uint64_t start_address;
+    uint64_t end_address;
+    uint64_t fingerprint;
+    uint64_t byte_size;
+    uint64_t instruction_count;
+    uint64_t instruction_hash;
+    uint64_t graph_hash;
+    uint64_t range_hash;
+    uint64_t byte_hash;
+    // sketch indexes the sketch pool, the reference lists the word pool
+    slice sketch;
+    slice call_targets;
+    slice data_refs;
+    slice constants;
+    slice blocks;
+    subroutine_analyzer::feature_vector features;
+  };
+
+  struct block_record {
+    uint64_t start_address;
+    uint64_t end_address;
+    uint64_t match_hash;
+    slice successor_keys;
+    // both key lists index the word pool
+    slice instruction_keys;
+    slice match_keys;
+    slice instructions;
+  };
+
+  struct string_record {
+    uint64_t offset;
+    uint64_t length;
+  };
+
+  public:
+  class block_view {
+    public:
+    [[nodiscard]] auto start_address() const -> uint64_t {
+      return record_->start_address;
+    }
+    [[nodiscard]] auto end_address() const -> uint64_t {
+      return record_->end_address;
+    }
+    [[nodiscard]] auto match_hash() const -> uint64_t {
+      return record_->match_hash;
+    }
+    [[nodiscard]] auto successor_keys() const -> std::span<const int64_t> {
+      return view_->successors_.subspan(record_->successor_keys.first, record_->successor_keys.count);
+    }
+    [[nodiscard]] auto instruction_keys() const -> std::span<const uint64_t> {
+      return view_->words_.subspan(record_->instruction_keys.first, record_->instruction_keys.count);
+    }
+    [[nodiscard]] auto match_keys() const -> std::span<const uint64_t> {
+      return view_->words_.subspan(record_->match_keys.first, record_->match_keys.count);
+    }
+    // zero when the diff was produced without instruction text
+    [[nodiscard]] auto instruction_count() const -> size_t {
+      return static_cast<size_t>(record_->instructions.count);
+    }
+    [[nodiscard]] auto instruction(size_t index) const -> std::string_view {
+      return view_->string(record_->instructions.first + index);
+    }
+
+    private:
+    friend class diff_view;
+
+    block_view(const diff_view* view, const block_record* record) : view_(view), record_(record) {
+    }
+
+    const diff_view* view_;
+    const block_record* record_;
+  };
+
+  class subroutine_view {
+    public:
+    [[nodiscard]] auto start_address() const -> uint64_t {
+      return record_->start_address;
+    }
+    [[nodiscard]] auto end_address() const -> uint64_t {
+      return record_->end_address;
+    }
+    [[nodiscard]] auto code_fingerprint() const -> fingerprint {
+      return static_cast<fingerprint>(record_->fingerprint);
+    }
+    [[nodiscard]] auto byte_size() const -> size_t {
+      return static_cast<size_t>(record_->byte_size);
+    }
+    [[nodiscard]] auto instruction_count() const -> size_t {
+      return static_cast<size_t>(record_->instruction_count);
+    }
+    [[nodiscard]] auto instruction_hash() const -> uint64_t {
+      return record_->instruction_hash;
+    }
+    [[nodiscard]] auto graph_hash() const -> uint64_t {
+      return record_->graph_hash;
+    }
+    [[nodiscard]] auto range_hash() const -> uint64_t {
+      return record_->range_hash;
+    }
+    [[nodiscard]] auto byte_hash() const -> uint64_t {
+      return record_->byte_hash;
+    }
+    [[nodiscard]] auto sketch() const -> std::span<const uint32_t> {
+      return view_->sketches_.subspan(record_->sketch.first, record_->sketch.count);
+    }
+    [[nodiscard]] auto call_targets() const -> std::span<const uint64_t> {
+      return view_->words_.subspan(record_->call_targets.first, record_->call_targets.count);
+    }
+    [[nodiscard]] auto data_refs() const -> std::span<const uint64_t> {
+      return view_->words_.subspan(record_->data_refs.first, record_->data_refs.count);
+    }
+    [[nodiscard]] auto constants() const -> std::span<const uint64_t> {
+      return view_->words_.subspan(record_->constants.first, record_->constants.count);
+    }
+    [[nodiscard]] auto features() const -> const subroutine_analyzer::feature_vector& {
+      return record_->features;
+    }
+    [[nodiscard]] auto block_count() const -> size_t {
+      return static_cast<size_t>(record_->blocks.count);
+    }
+    [[nodiscard]] auto block(size_t index) const -> block_view {
+      return {view_, &view_->blocks_[record_->blocks.first + index]};
+    }
+
+    // deep copy into the analyzer representation
+    [[nodiscard]] auto materialize() const -> subroutine_analyzer::subroutine;
+
+    private:
+    friend class diff_view;
+
+    subroutine_view(const diff_view* view, const subroutine_record* record) : view_(view), record_(record) {
+    }
+
+    const diff_view* view_;
+    const subroutine_record* record_;
+  };
+
+  class match_view {
+    public:
+    [[nodiscard]] auto primary() const -> subroutine_view {
+      return view_->subroutine(record_->primary);
+    }
+    [[nodiscard]] auto secondary() const -> subroutine_view {
+      return view_->subroutine(record_->secondary);
+    }
+    [[nodiscard]] auto change() const -> binary_differ::change_type {
+      return record_->change;
+    }
+    [[nodiscard]] auto similarity() const -> double {
+      return record_->similarity;
+    }
+
+    private:
+    friend class diff_view;
+
+    match_view(const diff_view* view, const match_record* record) : view_(view), record_(record) {
+    }
+
+    const diff_view* view_;
+    const match_record* record_;
+  };
+
+  [[nodiscard]] static auto save(const binary_differ::diff_result& result, const std::string& filepath) -> bool;
+  [[nodiscard]] static auto open(const std::string& filepath) -> std::expected<diff_view, std::string>;
+  // true when the file starts with the table magic
+  [[nodiscard]] static auto is_table(std::span<const uint8_t> prefix) -> bool;
+
+  [[nodiscard]] auto primary_count() const -> size_t {
+    return static_cast<size_t>(header_->primary_count);
+  }
+  [[nodiscard]] auto secondary_count() const -> size_t {
+    return static_cast<size_t>(header_->secondary_count);
+  }
+  [[nodiscard]] auto skipped_candidates() const -> size_t {
+    return static_cast<size_t>(header_->skipped_candidates);
+  }
+  [[nodiscard]] auto prefiltered_candidates() const -> size_t {
+    return static_cast<size_t>(header_->prefiltered_candidates);
+  }
+  [[nodiscard]] auto match_count() const -> size_t {
+    return matches_.size();
+  }
+  [[nodiscard]] auto match(size_t index) const -> match_view {
+    return {this, &matches_[index]};
+  }
+  [[nodiscard]] auto unmatched_primary_count() const -> size_t {
+    return unmatched_primary_.size();
+  }
+  [[nodiscard]] auto unmatched_primary(size_t index) const -> subroutine_view {
+    return subroutine(unmatched_primary_[index]);
+  }
+  [[nodiscard]] auto unmatched_secondary_count() const -> size_t {
+    return unmatched_secondary_.size();
+  }
+  [[nodiscard]] auto unmatched_secondary(size_t index) const -> subroutine_view {
+    return subroutine(unmatched_secondary_[index]);
+  }
+
+  // deep copy of the whole diff
+  [[nodiscard]] auto materialize() const -> binary_differ::diff_result;
+
+  private:
+  explicit diff_view(file_mapping mapping) : mapping_(std::move(mapping)) {
+  }
+
+  [[nodiscard]] auto subroutine(uint32_t index) const -> subroutine_view {
+    return {this, &subroutines_[index]};
+  }
+  [[nodiscard]] auto string(uint64_t index) const -> std::string_view {
+    const auto& record = strings_[index];
+    return {text_.data() + record.offset, static_cast<size_t>(record.length)};
+  }
+  [[nodiscard]] auto validate() const -> bool;
+
+  file_mapping mapping_;
+  const header* header_{nullptr};
+  std::span<const match_record> matches_;
+  std::span<const uint32_t> unmatched_primary_;
+  std::span<const uint32_t> unmatched_secondary_;
+  std::span<const subroutine_record> subroutines_;
+  std::span<const block_record> blocks_;
+  std::span<const uint64_t> words_;
+  std::span<const int64_t> successors_;
+  std::span<const uint32_t> sketches_;
+  std::span<const string_record> strings_;
+  std::span<const char> text_;
+};
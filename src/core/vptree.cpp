@@ -0,0 +1,109 @@
+#include "vptree.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+vantage_point_tree::vantage_point_tree(std::vector<float> points, size_t dimension) :
+    points_(std::move(points)), dimension_(std::max(size_t{1}, dimension)) {
+  std::vector<uint32_t> indices(points_.size() / dimension_);
+  std::iota(indices.begin(), indices.end(), uint32_t{0});
+  nodes_.reserve(indices.size());
+  root_ = build(indices);
+}
+
+std::vector<size_t> vantage_point_tree::nearest(std::span<const float> query, size_t k) const {
+  std::vector<neighbour> heap;
+  if (k == 0 || query.size() != dimension_) {
+    return {};
+  }
+  heap.reserve(k + 1);
+  search(root_, query, k, heap);
+
+  std::sort_heap(heap.begin(), heap.end());
+  std::vector<size_t> result;
+  result.reserve(heap.size());
+  for (const auto& entry : heap) {
+    result.push_back(entry.point);
+  }
+  return result;
+}
+
+// the first point becomes the vantage point and the median distance to it splits the rest in half
+uint32_t vantage_point_tree::build(std::span<uint32_t> indices) {
+  if (indices.empty()) {
+    return no_node;
+  }
+
+  const auto index = static_cast<uint32_t>(nodes_.size());
+  nodes_.push_back({.point = indices.front(), .radius = 0.0f, .inside = no_node, .outside = no_node});
+  const auto rest = indices.subspan(1);
+  if (rest.empty()) {
+    return index;
+  }
+
+  const std::span<const float> vantage(points_.data() + size_t{indices.front()} * dimension_, dimension_);
+  std::vector<std::pair<float, uint32_t>> distances;
+  distances.reserve(rest.size());
+  for (const auto point : rest) {
+    distances.emplace_back(distance(vantage, point), point);
+  }
+  const auto split = rest.size() / 2;
+  std::ranges::nth_element(distances, distances.begin() + static_cast<std::ptrdiff_t>(split));
+  for (size_t i = 0; i < rest.size(); ++i) {
+    rest[i] = distances[i].second;
+  }
+  nodes_[index].radius = distances[split].first;
+
+  const auto inside = build(rest.first(split));
+  const auto outside = build(rest.subspan(split));
+  nodes_[index].inside = inside;
+  nodes_[index].outside = outside;
+  return index;
+}
+
+void vantage_point_tree::search(
+  uint32_t index, std::span<const float> query, size_t k, std::vector<neighbour>& heap
+) const {
+  if (index == no_node) {
+    return;
+  }
+
+  const auto& current = nodes_[index];
+  const auto current_distance = distance(query, current.point);
+  if (heap.size() < k || current_distance < heap.front().distance) {
+    heap.push_back({.distance = current_distance, .point = current.point});
+    std::push_heap(heap.begin(), heap.end());
+    if (heap.size() > k) {
+      std::pop_heap(heap.begin(), heap.end());
+      heap.pop_back();
+    }
+  }
+
+  // the nearer side goes first so the far side is usually ruled out by the shrinking worst distance
+  auto worst = [&] {
+    return heap.size() < k ? std::numeric_limits<float>::infinity() : heap.front().distance;
+  };
+  if (current_distance < current.radius) {
+    search(current.inside, query, k, heap);
+    if (current_distance + worst() >= current.radius) {
+      search(current.outside, query, k, heap);
+    }
+  } else {
+    search(current.outside, query, k, heap);
+    if (current_distance - worst() <= current.radius) {
+      search(current.inside, query, k, heap);
+    }
+  }
+}
+
+float vantage_point_tree::distance(std::span<const float> query, uint32_t point) const {
+  const auto* values = points_.data() + size_t{point} * dimension_;
+  float sum = 0.0f;
+  for (size_t i = 0; i < dimension_; ++i) {
+    const auto delta = query[i] - values[i];
+    sum += delta * delta;
+  }
+  return std::sqrt(sum);
+}
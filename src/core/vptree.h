@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+// vantage point tree over fixed width float vectors under euclidean distance
+class vantage_point_tree {
+  public:
+  // points holds count * dimension values, point i starts at i * dimension
+  vantage_point_tree(std::vector<float> points, size_t dimension);
+
+  // indices of the k points nearest to query, nearest first
+  [[nodiscard]] std::vector<size_t> nearest(std::span<const float> query, size_t k) const;
+
+  private:
+  static constexpr uint32_t no_node = std::numeric_limits<uint32_t>::max();
+
+  struct node {
+    uint32_t point;
+    float radius;
+    uint32_t inside;
+    uint32_t outside;
+  };
+
+  struct neighbour {
+    float distance;
+    size_t point;
+
+    [[nodiscard]] auto operator<(const neighbour& other) const -> bool {
+      return distance < other.distance || (distance == other.distance && point < other.point);
+    }
+  };
+
+  uint32_t build(std::span<uint32_t> indices);
+  void search(uint32_t index, std::span<const float> query, size_t k, std::vector<neighbour>& heap) const;
+  [[nodiscard]] float distance(std::span<const float> query, uint32_t point) const;
+
+  std::vector<float> points_;
+  size_t dimension_;
+  std::vector<node> nodes_;
+  uint32_t root_{no_node};
+};
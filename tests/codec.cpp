@@ -0,0 +1,144 @@
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <limits>
+#include <print>
+#include <string>
+#include <vector>
+#include "core/codec.h"
+#include "core/serializer.hpp"
+#include "random_diff.h"
+
+namespace {
+
+  using subroutine = subroutine_analyzer::subroutine;
+
+  // values at the ends of every encoding: addresses that wrap, blocks before the start, a block ending before it
+  // begins, the widest keys and feature counts, and empty text
+  [[nodiscard]] auto make_edge_subroutines() -> std::vector<subroutine> {
+    constexpr auto max = std::numeric_limits<uint64_t>::max();
+    subroutine high{};
+    high.start_address = max - 0x10;
+    high.end_address = max;
+    high.fingerprint = static_cast<fingerprint>(max);
+    high.byte_size = std::numeric_limits<size_t>::max();
+    high.call_targets = {0, 1, max};
+    high.data_refs = {max - 0x20, max};
+    high.constants = {0, max};
+    high.features.fill(std::numeric_limits<uint16_t>::max());
+    high.basic_blocks.push_back({
+      .start_address = 0x1000,
+      .end_address = 0x10,
+      .successor_keys = {std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(), 0},
+      .instructions = {"", std::string(300, 'x'), ""},
+      .instruction_keys = {max, 0, max},
+      .match_keys = {0, max},
+      .match_hash = 0,
+    });
+    high.basic_blocks.push_back({
+      .start_address = max - 0x8,
+      .end_address = max,
+      .successor_keys = {},
+      .instructions = {},
+      .instruction_keys = {},
+      .match_keys = {},
+    });
+
+    subroutine empty{};
+    empty.start_address = 0;
+    empty.end_address = 0;
+    return {high, empty};
+  }
+
+  // every subroutine through one dictionary, the dictionary read back first as the file formats do
+  [[nodiscard]] auto check_codec(const std::vector<subroutine>& expected, const std::string& name) -> bool {
+    buffer_writer records;
+    subroutine_codec::dictionary_builder builder;
+    for (const auto& sub : expected) {
+      subroutine_codec::write(records, sub, builder);
+    }
+    buffer_writer dictionary;
+    builder.write(dictionary);
+
+    buffer_reader dictionary_reader(dictionary.data());
+    auto dict = subroutine_codec::dictionary::read(dictionary_reader);
+    if (!dict || dictionary_reader.remaining() != 0) {
+      std::println(stderr, "{}: the dictionary does not read back: {}", name, dict ? "bytes left over" : dict.error());
+      return false;
+    }
+
+    buffer_reader reader(records.data());
+    for (size_t i = 0; i < expected.size(); ++i) {
+      auto sub = subroutine_codec::read(reader, *dict);
+      if (!sub) {
+        std::println(stderr, "{}: subroutine {} does not decode: {}", name, i, sub.error());
+        return false;
+      }
+      if (*sub != expected[i]) {
+        std::println(stderr, "{}: subroutine {} at {:#x} differs after decoding", name, i, expected[i].start_address);
+        return false;
+      }
+    }
+    if (reader.remaining() != 0) {
+      std::println(stderr, "{}: {} bytes left after the last subroutine", name, reader.remaining());
+      return false;
+    }
+    return true;
+  }
+
+  [[nodiscard]] auto check_file(const binary_differ::diff_result& expected, const std::filesystem::path& path) -> bool {
+    if (!diff_serializer::save(expected, path.string())) {
+      std::println(stderr, "{}: failed to save the diff", path.string());
+      return false;
+    }
+    auto loaded = diff_serializer::load(path.string());
+    std::filesystem::remove(path);
+    if (!loaded) {
+      std::println(stderr, "{}: failed to load the diff: {}", path.string(), loaded.error());
+      return false;
+    }
+    if (*loaded != expected) {
+      const auto difference = random_diff::first_difference(expected, *loaded);
+      std::println(stderr, "{}: the loaded diff differs in {}", path.string(), difference);
+      return false;
+    }
+    return true;
+  }
+
+} // namespace
+
+// subroutine_codec on its own and diff_serializer around it have to give back every field they were handed
+int main() {
+  bool passed = check_codec(make_edge_subroutines(), "edge subroutines");
+
+  for (const auto record_count : std::array<size_t, 4>{0, 1, 64, 1000}) {
+    for (uint64_t seed = 0; seed < 4; ++seed) {
+      const auto expected = random_diff::make_diff(seed, record_count);
+      const auto name = std::format("codec_{}_{}", record_count, seed);
+
+      std::vector<subroutine> subroutines;
+      for (const auto& match : expected.matches) {
+        subroutines.push_back(match.primary);
+        subroutines.push_back(match.secondary);
+      }
+      subroutines.insert(subroutines.end(), expected.unmatched_primary.begin(), expected.unmatched_primary.end());
+      subroutines.insert(subroutines.end(), expected.unmatched_secondary.begin(), expected.unmatched_secondary.end());
+      passed = check_codec(subroutines, name) && passed;
+
+      // saved into the working directory, ctest runs every test from its own build directory
+      passed = check_file(expected, std::format("{}.zyd", name)) && passed;
+    }
+  }
+
+  // the edge subroutines as unmatched records, so the file format sees them too
+  binary_differ::diff_result edges;
+  edges.unmatched_primary = make_edge_subroutines();
+  edges.unmatched_secondary = make_edge_subroutines();
+  edges.primary_count = std::numeric_limits<size_t>::max();
+  passed = check_file(edges, "codec_edges.zyd") && passed;
+
+  std::println("{}", passed ? "codec round trips match" : "codec round trips differ");
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
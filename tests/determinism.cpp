@@ -0,0 +1,65 @@
+#include <array>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <print>
+#include <string>
+#include <utility>
+#include <vector>
+#include "core/differ.h"
+#include "core/serializer.hpp"
+
+namespace {
+
+  [[nodiscard]] auto read_file(const std::filesystem::path& path) -> std::optional<std::vector<char>> {
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) {
+      return std::nullopt;
+    }
+    return std::vector<char>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+  }
+
+} // namespace
+
+// worker_count promises results that never depend on it, so every thread count has to save the same bytes
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    std::println(stderr, "Usage: {} <primary_binary> <secondary_binary>", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  constexpr std::array<size_t, 3> thread_counts{1, 4, 64};
+  std::optional<std::vector<char>> expected;
+  bool passed = true;
+  for (const auto threads : thread_counts) {
+    binary_differ::compare_options options;
+    options.worker_count = threads;
+    binary_differ differ(argv[1], argv[2], options);
+    const auto result = differ.compare();
+
+    // saved into the working directory, ctest runs every test from its own build directory
+    const std::filesystem::path path(std::format("determinism_{}.zyd", threads));
+    if (!diff_serializer::save(result, path.string())) {
+      std::println(stderr, "failed to save the diff at {} threads", threads);
+      return EXIT_FAILURE;
+    }
+    auto bytes = read_file(path);
+    std::filesystem::remove(path);
+    if (!bytes) {
+      std::println(stderr, "failed to read the diff saved at {} threads", threads);
+      return EXIT_FAILURE;
+    }
+
+    std::println("{} threads: {} matches, {} bytes", threads, result.matches.size(), bytes->size());
+    if (!expected) {
+      expected = std::move(bytes);
+    } else if (*bytes != *expected) {
+      std::println(stderr, "the diff at {} threads differs from the one at {} threads", threads, thread_counts[0]);
+      passed = false;
+    }
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
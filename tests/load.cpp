@@ -0,0 +1,243 @@
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <print>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+#include "core/serializer.hpp"
+#include "random_diff.h"
+
+namespace {
+
+  // 1 decodes inline, the rest split the batches between threads, 0 takes every hardware thread
+  constexpr std::array<size_t, 4> worker_counts{1, 3, 8, 0};
+  // the footer offset and the magic that close every file
+  constexpr size_t trailer_size = sizeof(uint64_t) + sizeof(uint32_t);
+
+  [[nodiscard]] auto read_bytes(const std::string& path) -> std::vector<uint8_t> {
+    std::ifstream stream(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()};
+  }
+
+  void write_bytes(const std::string& path, std::span<const uint8_t> bytes) {
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    stream.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+  }
+
+  [[nodiscard]] auto get_word(std::span<const uint8_t> bytes, size_t offset) -> uint64_t {
+    uint64_t value{};
+    std::memcpy(&value, bytes.data() + offset, sizeof(value));
+    return value;
+  }
+
+  void set_word(std::span<uint8_t> bytes, size_t offset, uint64_t value) {
+    std::memcpy(bytes.data() + offset, &value, sizeof(value));
+  }
+
+  // writes the records interleaved the way a streamed diff is, each kind keeping its own order
+  [[nodiscard]] auto save_interleaved(const binary_differ::diff_result& result, const std::string& path, uint64_t seed)
+    -> bool {
+    auto writer = diff_writer::open(path);
+    if (!writer) {
+      return false;
+    }
+    std::mt19937_64 random(seed);
+    size_t match = 0;
+    size_t primary = 0;
+    size_t secondary = 0;
+    while (
+      match < result.matches.size() || primary < result.unmatched_primary.size() ||
+      secondary < result.unmatched_secondary.size()
+    ) {
+      switch (random() % 3) {
+        case 0:
+          if (match < result.matches.size()) {
+            writer->add_match(result.matches[match++]);
+          }
+          break;
+        case 1:
+          if (primary < result.unmatched_primary.size()) {
+            writer->add_unmatched_primary(result.unmatched_primary[primary++]);
+          }
+          break;
+        default:
+          if (secondary < result.unmatched_secondary.size()) {
+            writer->add_unmatched_secondary(result.unmatched_secondary[secondary++]);
+          }
+          break;
+      }
+    }
+    return writer->finish({
+      .primary_count = result.primary_count,
+      .secondary_count = result.secondary_count,
+      .skipped_candidates = result.skipped_candidates,
+      .prefiltered_candidates = result.prefiltered_candidates,
+    });
+  }
+
+  // every worker count has to load the records exactly as they were added
+  [[nodiscard]] auto check_workers(const binary_differ::diff_result& expected, const std::string& path) -> bool {
+    bool passed = true;
+    for (const auto workers : worker_counts) {
+      auto loaded = diff_serializer::load(path, workers);
+      if (!loaded) {
+        std::println(stderr, "{}: failed to load at {} workers: {}", path, workers, loaded.error());
+        passed = false;
+      } else if (*loaded != expected) {
+        const auto difference = random_diff::first_difference(expected, *loaded);
+        std::println(stderr, "{}: the diff loaded at {} workers differs in {}", path, workers, difference);
+        passed = false;
+      }
+    }
+    return passed;
+  }
+
+  // what a damaged file has to produce. damage the layout checks miss may still decode into some other diff, but
+  // never by reading past the file
+  enum class outcome : uint8_t {
+    // the footer itself is unusable, so load and lookup both refuse
+    errors,
+    // the record area no longer tiles, which only load checks as a whole
+    load_error,
+    anything,
+  };
+
+  // loads the damaged bytes at one and several workers and looks up the first subroutine of each side
+  [[nodiscard]] auto load_damaged(
+    const std::string& path, std::span<const uint8_t> bytes, const std::array<uint64_t, 2>& addresses, outcome expected
+  ) -> bool {
+    write_bytes(path, bytes);
+    bool passed = true;
+    for (const auto workers : {size_t{1}, size_t{4}}) {
+      if (diff_serializer::load(path, workers) && expected != outcome::anything) {
+        passed = false;
+      }
+    }
+    for (const auto which : {diff_serializer::side::primary, diff_serializer::side::secondary}) {
+      const auto address = addresses[static_cast<size_t>(which)];
+      if (diff_serializer::lookup(path, address, which) && expected == outcome::errors) {
+        passed = false;
+      }
+    }
+    return passed;
+  }
+
+  [[nodiscard]] auto check_damage(const binary_differ::diff_result& result, const std::string& path) -> bool {
+    if (!diff_serializer::save(result, path)) {
+      std::println(stderr, "{}: failed to save the diff", path);
+      return false;
+    }
+    const auto bytes = read_bytes(path);
+    const std::array<uint64_t, 2> addresses{
+      result.matches.front().primary.start_address,
+      result.matches.front().secondary.start_address,
+    };
+    bool passed = true;
+    auto expect_outcome = [&](std::span<const uint8_t> damaged, outcome expected, const std::string& damage) {
+      if (!load_damaged(path, damaged, addresses, expected)) {
+        std::println(stderr, "{}: read a diff with {}", path, damage);
+        passed = false;
+      }
+    };
+
+    // every truncation loses the trailer
+    for (size_t size = 0; size < bytes.size(); ++size) {
+      const auto damage = std::format("only {} of {} bytes", size, bytes.size());
+      expect_outcome(std::span(bytes).first(size), outcome::errors, damage);
+    }
+
+    // the tables at the end of the footer, walked back from the trailer: secondary index, primary index, offsets
+    const auto primary_records = result.matches.size() + result.unmatched_primary.size();
+    const auto secondary_records = result.matches.size() + result.unmatched_secondary.size();
+    const auto record_count = primary_records + result.unmatched_secondary.size();
+    const auto index_size = [](size_t entries) {
+      return sizeof(uint64_t) + entries * sizeof(diff_writer::index_entry);
+    };
+    const auto offsets_end = bytes.size() - trailer_size - index_size(secondary_records) - index_size(primary_records);
+    const auto offsets_start = offsets_end - (record_count + 1) * sizeof(uint64_t);
+    const auto footer_offset = get_word(bytes, bytes.size() - trailer_size);
+    if (get_word(bytes, offsets_start) != record_count || footer_offset >= offsets_start) {
+      std::println(stderr, "{}: the footer layout is not the one this test expects", path);
+      return false;
+    }
+
+    auto damage_word = [&](size_t offset, uint64_t value, outcome expected, const std::string& damage) {
+      auto damaged = bytes;
+      set_word(damaged, offset, value);
+      expect_outcome(damaged, expected, damage);
+    };
+    const auto trailer = bytes.size() - trailer_size;
+    for (const uint64_t value : {uint64_t{0}, uint64_t{7}, uint64_t{trailer}, uint64_t{bytes.size()}, ~uint64_t{0}}) {
+      damage_word(trailer, value, outcome::errors, std::format("the footer offset {:#x}", value));
+    }
+    // a footer moved by a byte misreads its own fields, and the records no longer end where it starts
+    for (const auto value : {footer_offset - 1, footer_offset + 1}) {
+      damage_word(trailer, value, outcome::load_error, std::format("the footer offset {:#x}", value));
+    }
+    // the record counts follow the four result counts, the offset table has to agree with them
+    for (size_t word = 4; word < 7; ++word) {
+      const auto offset = static_cast<size_t>(footer_offset) + word * sizeof(uint64_t);
+      const auto count = get_word(bytes, offset);
+      for (const auto value : {count + 1, ~uint64_t{0}}) {
+        damage_word(offset, value, outcome::errors, std::format("record count {} set to {}", word - 4, value));
+      }
+    }
+    for (const uint64_t value : {uint64_t{record_count - 1}, uint64_t{record_count + 1}, uint64_t{1} << 60}) {
+      damage_word(offsets_start, value, outcome::errors, std::format("{} entries in the offset table", value));
+    }
+    // lookup trusts the offsets of records it does not read, load checks every one
+    for (size_t i = 0; i < record_count; ++i) {
+      const auto offset = offsets_start + (i + 1) * sizeof(uint64_t);
+      const auto entry = get_word(bytes, offset);
+      for (const auto value : {entry - 1, entry + 1, uint64_t{0}, footer_offset, ~entry}) {
+        damage_word(offset, value, outcome::load_error, std::format("record offset {} set to {:#x}", i, value));
+      }
+    }
+
+    // anything else may be damaged into another valid diff, so flipping each byte only has to stay in bounds
+    for (size_t i = 0; i < bytes.size(); ++i) {
+      auto damaged = bytes;
+      damaged[i] ^= 0xa5;
+      (void)load_damaged(path, damaged, addresses, outcome::anything);
+    }
+
+    std::filesystem::remove(path);
+    return passed;
+  }
+
+} // namespace
+
+// load decodes records on several threads from the offset table. the worker count must not change what it returns,
+// and a damaged footer or offset table must come back as an error rather than a crash
+int main() {
+  bool passed = true;
+  for (const auto record_count : std::array<size_t, 4>{0, 1, 255, 3000}) {
+    for (uint64_t seed = 0; seed < 2; ++seed) {
+      const auto expected = random_diff::make_diff(seed, record_count);
+      // saved into the working directory, ctest runs every test from its own build directory
+      const auto path = std::format("load_{}_{}.zyd", record_count, seed);
+      if (!diff_serializer::save(expected, path) || !save_interleaved(expected, path + ".streamed", seed)) {
+        std::println(stderr, "{}: failed to save the diff", path);
+        return EXIT_FAILURE;
+      }
+      passed = check_workers(expected, path) && passed;
+      passed = check_workers(expected, path + ".streamed") && passed;
+      std::filesystem::remove(path);
+      std::filesystem::remove(path + ".streamed");
+    }
+  }
+
+  for (uint64_t seed = 0; seed < 2; ++seed) {
+    passed = check_damage(random_diff::make_diff(seed, 12), std::format("load_damaged_{}.zyd", seed)) && passed;
+  }
+
+  std::println("{}", passed ? "loads match" : "loads differ");
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
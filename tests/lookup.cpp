@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <limits>
+#include <print>
+#include <string>
+#include <vector>
+#include "core/serializer.hpp"
+#include "core/view.h"
+#include "random_diff.h"
+
+namespace {
+
+  using side = diff_serializer::side;
+
+  // a subroutine on the looked up side and what lookup returns inside it: the counts and the one record holding it
+  struct covered {
+    const subroutine_analyzer::subroutine* sub;
+    binary_differ::diff_result expected;
+  };
+
+  [[nodiscard]] auto counts_of(const binary_differ::diff_result& result) -> binary_differ::diff_result {
+    binary_differ::diff_result counts;
+    counts.primary_count = result.primary_count;
+    counts.secondary_count = result.secondary_count;
+    counts.skipped_candidates = result.skipped_candidates;
+    counts.prefiltered_candidates = result.prefiltered_candidates;
+    return counts;
+  }
+
+  [[nodiscard]] auto collect(const binary_differ::diff_result& result, side which) -> std::vector<covered> {
+    std::vector<covered> records;
+    for (const auto& match : result.matches) {
+      covered record{.sub = which == side::primary ? &match.primary : &match.secondary, .expected = counts_of(result)};
+      record.expected.matches.push_back(match);
+      records.push_back(std::move(record));
+    }
+    for (const auto& sub : which == side::primary ? result.unmatched_primary : result.unmatched_secondary) {
+      covered record{.sub = &sub, .expected = counts_of(result)};
+      (which == side::primary ? record.expected.unmatched_primary : record.expected.unmatched_secondary).push_back(sub);
+      records.push_back(std::move(record));
+    }
+    std::ranges::sort(records, {}, [](const covered& record) {
+      return record.sub->start_address;
+    });
+    return records;
+  }
+
+  [[nodiscard]] auto check(const binary_differ::diff_result& result, const std::string& path) -> bool {
+    bool passed = true;
+    auto expect = [&](uint64_t address, side which, const binary_differ::diff_result& expected) {
+      const auto side_name = which == side::primary ? "primary" : "secondary";
+      auto found = diff_serializer::lookup(path, address, which);
+      if (!found) {
+        std::println(stderr, "{}: {} lookup of {:#x} failed: {}", path, side_name, address, found.error());
+        passed = false;
+      } else if (*found != expected) {
+        const auto difference = random_diff::first_difference(expected, *found);
+        std::println(stderr, "{}: {} lookup of {:#x} differs in {}", path, side_name, address, difference);
+        passed = false;
+      }
+    };
+
+    const auto nothing = counts_of(result);
+    for (const auto which : {side::primary, side::secondary}) {
+      const auto records = collect(result, which);
+      for (size_t i = 0; i < records.size(); ++i) {
+        const auto& [sub, expected] = records[i];
+        // end_address is one past the last byte
+        expect(sub->start_address, which, expected);
+        expect(sub->start_address + (sub->end_address - sub->start_address) / 2, which, expected);
+        expect(sub->end_address - 1, which, expected);
+        // the generator leaves a gap after every subroutine
+        expect(sub->end_address, which, nothing);
+        if (i == 0) {
+          expect(sub->start_address - 1, which, nothing);
+          expect(0, which, nothing);
+        }
+      }
+      expect(std::numeric_limits<uint64_t>::max(), which, nothing);
+    }
+    return passed;
+  }
+
+} // namespace
+
+// lookup has to find the record covering an address on either side through the footer index, and nothing for
+// addresses no subroutine on that side covers
+int main() {
+  bool passed = true;
+  for (const auto record_count : std::array<size_t, 3>{0, 1, 600}) {
+    for (uint64_t seed = 0; seed < 4; ++seed) {
+      const auto result = random_diff::make_diff(seed, record_count);
+      // saved into the working directory, ctest runs every test from its own build directory
+      const auto path = std::format("lookup_{}_{}.zyd", record_count, seed);
+      if (!diff_serializer::save(result, path)) {
+        std::println(stderr, "{}: failed to save the diff", path);
+        return EXIT_FAILURE;
+      }
+      passed = check(result, path) && passed;
+      std::filesystem::remove(path);
+    }
+  }
+
+  // table files have no address index and say so instead of answering
+  const auto table_path = std::string("lookup.zydt");
+  if (!diff_view::save(random_diff::make_diff(0, 8), table_path)) {
+    std::println(stderr, "{}: failed to save the tables", table_path);
+    return EXIT_FAILURE;
+  }
+  if (diff_serializer::lookup(table_path, 0, side::primary)) {
+    std::println(stderr, "{}: lookup answered for a table file", table_path);
+    passed = false;
+  }
+  std::filesystem::remove(table_path);
+
+  std::println("{}", passed ? "lookups match" : "lookups differ");
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
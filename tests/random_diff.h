@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <format>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "core/differ.h"
+
+// random diffs for the serialization tests. every field of every record is set, and the subroutines of one side never
+// overlap and leave gaps between them, so some addresses are covered by nothing
+namespace random_diff {
+
+  using subroutine = subroutine_analyzer::subroutine;
+
+  // shared mnemonics give the dictionary repeats to intern, the empty string and the odd unique line test the edges
+  constexpr std::array<const char*, 8> mnemonics{
+    "mov rax, rbx", "push rbp", "call 0x1000", "ret", "lea rcx, [rip]", "cmp eax, 1", "jne 0x20", "",
+  };
+
+  [[nodiscard]] inline auto make_values(std::mt19937_64& random, size_t count, uint64_t around)
+    -> std::vector<uint64_t> {
+    std::vector<uint64_t> values;
+    for (size_t i = 0; i < count; ++i) {
+      // half near the subroutine, some below it so the gaps wrap, the rest anywhere
+      switch (random() % 3) {
+        case 0:
+          values.push_back(around + random() % 0x10000);
+          break;
+        case 1:
+          values.push_back(around - random() % 0x10000);
+          break;
+        default:
+          values.push_back(random());
+          break;
+      }
+    }
+    std::ranges::sort(values);
+    return values;
+  }
+
+  [[nodiscard]] inline auto make_block(std::mt19937_64& random, uint64_t start) -> subroutine_analyzer::basic_block {
+    subroutine_analyzer::basic_block block;
+    block.start_address = start;
+    block.end_address = start + 1 + random() % 0x20;
+    const auto successor_count = random() % 3;
+    for (size_t i = 0; i < successor_count; ++i) {
+      block.successor_keys.push_back(static_cast<int64_t>(random() % 9) - 4);
+    }
+    const auto instruction_count = random() % 9;
+    const auto with_text = random() % 4 != 0;
+    for (size_t i = 0; i < instruction_count; ++i) {
+      // mostly small keys that repeat across records, now and then a full width one
+      block.instruction_keys.push_back(random() % 8 == 0 ? random() : random() % 32);
+      block.match_keys.push_back(random() % 8 == 0 ? random() : random() % 16);
+      if (with_text) {
+        block.instructions.emplace_back(
+          random() % 16 == 0 ? std::format("nop {:#x}", random()) : mnemonics[random() % mnemonics.size()]
+        );
+      }
+    }
+    block.match_hash = random();
+    return block;
+  }
+
+  // places the subroutine after cursor and moves cursor past its end
+  [[nodiscard]] inline auto make_subroutine(std::mt19937_64& random, uint64_t& cursor) -> subroutine {
+    subroutine sub{};
+    sub.start_address = cursor + 1 + random() % 0x40;
+    sub.end_address = sub.start_address + 1 + random() % 0x20;
+
+    auto address = sub.start_address;
+    const auto block_count = random() % 6;
+    for (size_t i = 0; i < block_count; ++i) {
+      auto block = make_block(random, address + (i != 0 && random() % 4 == 0 ? random() % 4 : 0));
+      address = block.end_address;
+      sub.end_address = std::max(sub.end_address, address);
+      sub.basic_blocks.push_back(std::move(block));
+    }
+    // the analyzer keeps discovery order, so blocks are not always sorted by address
+    if (random() % 4 == 0) {
+      std::ranges::shuffle(sub.basic_blocks, random);
+    }
+    cursor = sub.end_address;
+
+    sub.fingerprint = static_cast<fingerprint>(random());
+    sub.byte_size = static_cast<size_t>(sub.end_address - sub.start_address);
+    sub.instruction_count = random() % 0x100;
+    sub.instruction_hash = random();
+    sub.graph_hash = random();
+    sub.range_hash = random() % 2 == 0 ? 0 : random();
+    sub.byte_hash = random();
+    if (random() % 4 != 0) {
+      sub.sketch.resize(subroutine_analyzer::sketch_size);
+      for (auto& value : sub.sketch) {
+        value = static_cast<uint32_t>(random());
+      }
+    }
+    sub.call_targets = make_values(random, random() % 4, sub.start_address);
+    sub.data_refs = make_values(random, random() % 4, sub.start_address);
+    sub.constants = make_values(random, random() % 3, 0);
+    for (auto& count : sub.features) {
+      count = static_cast<uint16_t>(random());
+    }
+    return sub;
+  }
+
+  // record_count records split between matches and the two unmatched lists, written in shuffled address order
+  [[nodiscard]] inline auto make_diff(uint64_t seed, size_t record_count) -> binary_differ::diff_result {
+    std::mt19937_64 random(seed);
+    const auto match_count = record_count / 2 + random() % (record_count / 4 + 1);
+    const auto unmatched_primary_count = (record_count - match_count) / 2;
+    const auto unmatched_secondary_count = record_count - match_count - unmatched_primary_count;
+
+    auto make_side = [&](uint64_t base, size_t count) {
+      std::vector<subroutine> subroutines;
+      auto cursor = base;
+      for (size_t i = 0; i < count; ++i) {
+        subroutines.push_back(make_subroutine(random, cursor));
+      }
+      std::ranges::shuffle(subroutines, random);
+      return subroutines;
+    };
+    auto primaries = make_side(0x140001000, match_count + unmatched_primary_count);
+    auto secondaries = make_side(0x401000, match_count + unmatched_secondary_count);
+
+    binary_differ::diff_result result;
+    for (size_t i = 0; i < match_count; ++i) {
+      const auto change = static_cast<binary_differ::change_type>(random() % 4);
+      // the ends of the range as well as the values between them
+      const auto similarity = change == binary_differ::change_type::unchanged
+                              ? 1.0
+                              : std::uniform_real_distribution<double>(0.0, 1.0)(random);
+      result.matches.push_back({
+        .primary = std::move(primaries[i]),
+        .secondary = std::move(secondaries[i]),
+        .change = change,
+        .similarity = i == 0 ? 0.0 : similarity,
+      });
+    }
+    result.unmatched_primary.assign(
+      std::make_move_iterator(primaries.begin() + static_cast<ptrdiff_t>(match_count)),
+      std::make_move_iterator(primaries.end())
+    );
+    result.unmatched_secondary.assign(
+      std::make_move_iterator(secondaries.begin() + static_cast<ptrdiff_t>(match_count)),
+      std::make_move_iterator(secondaries.end())
+    );
+    result.primary_count = match_count + unmatched_primary_count;
+    result.secondary_count = match_count + unmatched_secondary_count;
+    result.skipped_candidates = random() % 1000000;
+    result.prefiltered_candidates = random() % 1000000;
+    return result;
+  }
+
+  // names the first record that differs for test output, empty when none does
+  [[nodiscard]] inline auto first_difference(
+    const binary_differ::diff_result& expected, const binary_differ::diff_result& actual
+  ) -> std::string {
+    if (
+      expected.primary_count != actual.primary_count || expected.secondary_count != actual.secondary_count ||
+      expected.skipped_candidates != actual.skipped_candidates ||
+      expected.prefiltered_candidates != actual.prefiltered_candidates
+    ) {
+      return "the counts";
+    }
+    auto compare = [](const auto& lhs, const auto& rhs, const char* name) -> std::string {
+      if (lhs.size() != rhs.size()) {
+        return std::format("{} count {} instead of {}", name, rhs.size(), lhs.size());
+      }
+      const auto [first, second] = std::ranges::mismatch(lhs, rhs);
+      return first == lhs.end() ? "" : std::format("{} {}", name, first - lhs.begin());
+    };
+    auto difference = compare(expected.matches, actual.matches, "match");
+    if (difference.empty()) {
+      difference = compare(expected.unmatched_primary, actual.unmatched_primary, "unmatched primary");
+    }
+    if (difference.empty()) {
+      difference = compare(expected.unmatched_secondary, actual.unmatched_secondary, "unmatched secondary");
+    }
+    return difference;
+  }
+
+} // namespace random_diff
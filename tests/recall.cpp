@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <print>
+#include <set>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include "core/differ.h"
+
+namespace {
+
+  using match_set = std::set<std::pair<uint64_t, uint64_t>>;
+
+  [[nodiscard]] auto collect_matches(const binary_differ::diff_result& result) -> match_set {
+    match_set matches;
+    for (const auto& match : result.matches) {
+      matches.emplace(match.primary.start_address, match.secondary.start_address);
+    }
+    return matches;
+  }
+
+  [[nodiscard]] auto run_diff(
+    const std::string& primary_path, const std::string& secondary_path, binary_differ::candidate_source source,
+    size_t fallback_limit, size_t pair_limit
+  ) -> binary_differ::diff_result {
+    binary_differ::compare_options options;
+    options.include_instructions = false;
+    options.fallback_candidates = source;
+    options.fallback_limit = fallback_limit;
+    options.pair_limit = pair_limit;
+    binary_differ differ(primary_path, secondary_path, options);
+    return differ.compare();
+  }
+
+  [[nodiscard]] auto without(const match_set& matches, const match_set& removed) -> match_set {
+    match_set remaining;
+    std::ranges::set_difference(matches, removed, std::inserter(remaining, remaining.end()));
+    return remaining;
+  }
+
+} // namespace
+
+// the share of fallback matches scoring every pair finds that the indexed candidate sources find as well. earlier
+// phases do not depend on the source, so a run without the fallback phase separates its matches out
+int main(int argc, char* argv[]) {
+  if (argc < 3) {
+    std::println(stderr, "Usage: {} <primary_binary> <secondary_binary> [minimum_recall]", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const std::string primary_path(argv[1]);
+  const std::string secondary_path(argv[2]);
+  double minimum_recall = 0.0;
+  if (argc > 3) {
+    const std::string_view value(argv[3]);
+    if (std::from_chars(value.data(), value.data() + value.size(), minimum_recall).ec != std::errc{}) {
+      std::println(stderr, "invalid minimum recall: {}", value);
+      return EXIT_FAILURE;
+    }
+  }
+
+  using enum binary_differ::candidate_source;
+  const auto fallback_limit = binary_differ::compare_options{}.fallback_limit;
+  constexpr auto unlimited = std::numeric_limits<size_t>::max();
+
+  // the run without a fallback phase leaves exactly the subroutines the fallback phase pairs up
+  const auto earlier_result = run_diff(primary_path, secondary_path, exhaustive, 0, unlimited);
+  const auto earlier = collect_matches(earlier_result);
+  const auto pair_count = earlier_result.unmatched_primary.size() * earlier_result.unmatched_secondary.size();
+  const auto expected =
+    without(collect_matches(run_diff(primary_path, secondary_path, exhaustive, fallback_limit, unlimited)), earlier);
+  std::println("exhaustive: {} fallback matches over {} pairs", expected.size(), pair_count);
+
+  // the candidate sources only apply past pair_limit, one pair short of every pair still leaves them room for all
+  // the candidates they pick
+  const auto pair_limit = pair_count == 0 ? 0 : pair_count - 1;
+  bool passed = true;
+  for (const auto& [source, name] : {std::pair{bands, "bands"}, std::pair{neighbours, "neighbours"}}) {
+    const auto found = without(
+      collect_matches(run_diff(primary_path, secondary_path, source, fallback_limit, pair_limit)), earlier
+    );
+    const auto kept = expected.size() - without(expected, found).size();
+    const auto recall = expected.empty() ? 1.0 : static_cast<double>(kept) / static_cast<double>(expected.size());
+    std::println("{}: {} fallback matches, {} of exhaustive, recall {:.3f}", name, found.size(), kept, recall);
+    if (source == binary_differ::compare_options{}.fallback_candidates && recall < minimum_recall) {
+      passed = false;
+    }
+  }
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
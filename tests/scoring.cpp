@@ -0,0 +1,134 @@
+#include <cstdint>
+#include <cstdlib>
+#include <print>
+#include <random>
+#include <vector>
+#include "core/differ.h"
+
+namespace {
+
+  using subroutine = subroutine_analyzer::subroutine;
+
+  // a small key alphabet so random blocks share instructions and score across the whole range
+  constexpr uint64_t key_count = 6;
+
+  void set_match_keys(subroutine_analyzer::basic_block& block) {
+    block.match_keys.clear();
+    block.match_hash = 14695981039346656037ull;
+    for (const auto key : block.instruction_keys) {
+      block.match_keys.push_back(key % 3);
+      block.match_hash = (block.match_hash ^ (key % 3)) * 1099511628211ull;
+    }
+  }
+
+  void set_features(subroutine& function) {
+    function.features = {};
+    subroutine_analyzer::add_block_features(function.features, function.basic_blocks);
+  }
+
+  [[nodiscard]] auto make_subroutine(std::mt19937_64& random) -> subroutine {
+    subroutine function{};
+    const auto block_count = 1 + random() % 12;
+    function.basic_blocks.resize(block_count);
+    for (size_t i = 0; i < block_count; ++i) {
+      auto& block = function.basic_blocks[i];
+      block.start_address = 0x1000 + i * 0x40;
+      block.end_address = block.start_address + 0x40;
+      // up to 13 instructions so blocks land in every size lane
+      const auto instruction_count = random() % 14;
+      for (size_t j = 0; j < instruction_count; ++j) {
+        block.instruction_keys.push_back(random() % key_count);
+      }
+      set_match_keys(block);
+      if (i + 1 < block_count) {
+        block.successor_keys.push_back(1);
+      }
+      if (random() % 3 == 0) {
+        block.successor_keys.push_back(static_cast<int64_t>(random() % block_count) - static_cast<int64_t>(i));
+      }
+    }
+    set_features(function);
+    return function;
+  }
+
+  // edits, drops and appends blocks so the pair lands anywhere between unrelated and identical
+  [[nodiscard]] auto mutate(const subroutine& original, std::mt19937_64& random) -> subroutine {
+    auto function = original;
+    const auto edits = random() % 8;
+    for (size_t i = 0; i < edits; ++i) {
+      auto& block = function.basic_blocks[random() % function.basic_blocks.size()];
+      switch (random() % 3) {
+        case 0:
+          block.instruction_keys.push_back(random() % key_count);
+          break;
+        case 1:
+          if (!block.instruction_keys.empty()) {
+            block.instruction_keys.erase(block.instruction_keys.begin() + random() % block.instruction_keys.size());
+          }
+          break;
+        default:
+          if (!block.instruction_keys.empty()) {
+            block.instruction_keys[random() % block.instruction_keys.size()] = random() % key_count;
+          }
+          break;
+      }
+      set_match_keys(block);
+    }
+    if (random() % 4 == 0 && function.basic_blocks.size() > 1) {
+      function.basic_blocks.pop_back();
+      function.basic_blocks.back().successor_keys.clear();
+    }
+    if (random() % 4 == 0) {
+      auto block = function.basic_blocks.back();
+      block.successor_keys.clear();
+      function.basic_blocks.push_back(std::move(block));
+    }
+    set_features(function);
+    return function;
+  }
+
+} // namespace
+
+// the fallback pool accepts a pair when its pruned score beats the threshold it was pruned at, so pruning must
+// never change which pairs pass or the similarity they pass with. pairs are only scored at all when score_bound
+// lets them through, so it must never fall below the full score
+int main() {
+  std::mt19937_64 random(0x5eed);
+  size_t accepted = 0;
+  size_t pruned = 0;
+  size_t bounded_out = 0;
+  size_t failures = 0;
+  for (size_t i = 0; i < 20000; ++i) {
+    const auto primary = make_subroutine(random);
+    const auto secondary = random() % 8 == 0 ? make_subroutine(random) : mutate(primary, random);
+    const auto exact = binary_differ::score_subroutines(primary, secondary, -1.0);
+    const auto feature_bound = binary_differ::score_bound(primary, secondary);
+    if (feature_bound < exact) {
+      std::println(stderr, "pair {}: score bound {} below full score {}", i, feature_bound, exact);
+      ++failures;
+    }
+    for (const auto threshold : {0.5, 0.7}) {
+      const auto bounded = binary_differ::score_subroutines(primary, secondary, threshold);
+      pruned += bounded != exact;
+      bounded_out += feature_bound <= threshold;
+      if ((bounded > threshold) != (exact > threshold) || (exact > threshold && bounded != exact)) {
+        std::println(
+          stderr, "pair {} at threshold {}: pruned score {} but full score {}", i, threshold, bounded, exact
+        );
+        ++failures;
+      }
+      // the pruning bound is summed in a different order, so it may round a hair below the full score
+      if (bounded < exact - 1e-9) {
+        std::println(
+          stderr, "pair {} at threshold {}: pruned score {} below full score {}", i, threshold, bounded, exact
+        );
+        ++failures;
+      }
+      accepted += exact > threshold;
+    }
+  }
+  std::println(
+    "{} accepted, {} pruned, {} under the score bound, {} mismatches", accepted, pruned, bounded_out, failures
+  );
+  return failures == 0 && accepted > 0 && pruned > 0 && bounded_out > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <print>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+#include "core/strings.h"
+
+namespace {
+
+  [[nodiscard]] auto is_string_byte(uint8_t value) -> bool {
+    return value == '\t' || (value >= 0x20 && value <= 0x7e);
+  }
+
+  // the byte at a time loop strings::scan replaced, and the same loop over the characters of each utf-16le phase
+  [[nodiscard]] auto reference_scan(std::span<const uint8_t> data, const strings::options& opts)
+    -> std::vector<strings::entry> {
+    std::vector<strings::entry> found;
+
+    size_t start = 0;
+    while (start < data.size()) {
+      while (start < data.size() && !is_string_byte(data[start])) {
+        ++start;
+      }
+
+      auto end = start;
+      while (end < data.size() && is_string_byte(data[end])) {
+        ++end;
+      }
+
+      if (end - start >= opts.min_length && end < data.size() && data[end] == 0) {
+        found.push_back({
+          .address = start,
+          .section = {},
+          .value = std::string(reinterpret_cast<const char*>(data.data() + start), end - start),
+          .xrefs = {},
+          .wide = false,
+        });
+      }
+
+      start = end + 1;
+    }
+
+    if (opts.wide) {
+      auto is_wide_char = [&](size_t i) {
+        return i + 1 < data.size() && is_string_byte(data[i]) && data[i + 1] == 0;
+      };
+      for (size_t phase = 0; phase < 2; ++phase) {
+        start = phase;
+        while (start < data.size()) {
+          while (start < data.size() && !is_wide_char(start)) {
+            start += 2;
+          }
+
+          auto end = start;
+          std::string value;
+          while (end < data.size() && is_wide_char(end)) {
+            value.push_back(static_cast<char>(data[end]));
+            end += 2;
+          }
+
+          if (value.size() >= opts.min_length && end + 1 < data.size() && data[end] == 0 && data[end + 1] == 0) {
+            found.push_back({
+              .address = start,
+              .section = {},
+              .value = std::move(value),
+              .xrefs = {},
+              .wide = true,
+            });
+          }
+
+          start = end + 2;
+        }
+      }
+    }
+
+    std::ranges::stable_sort(found, {}, &strings::entry::address);
+    return found;
+  }
+
+  // bytes at the edges of is_string_byte: tab, the ends of the printable range, delete, and printable bytes and tab
+  // with the high bit set
+  constexpr std::array<uint8_t, 12> edge_bytes{0x00, 0x08, 0x09, 0x0a, 0x1f, 0x20, 0x7e, 0x7f, 0x80, 0x89, 0xa0, 0xff};
+
+  [[nodiscard]] auto random_byte(std::mt19937_64& random) -> uint8_t {
+    switch (random() % 4) {
+      case 0:
+        return edge_bytes[random() % edge_bytes.size()];
+      case 1:
+        return 0x20 + static_cast<uint8_t>(random() % 0x5f);
+      default:
+        return static_cast<uint8_t>(random());
+    }
+  }
+
+  // ascii runs, utf-16le runs at either alignment and noise, each up to a few blocks long so runs cross block
+  // boundaries. the size is whatever the segments add up to, rarely a multiple of 64
+  [[nodiscard]] auto make_section(std::mt19937_64& random, size_t target_size) -> std::vector<uint8_t> {
+    std::vector<uint8_t> data;
+    while (data.size() < target_size) {
+      const auto length = random() % 3 == 0 ? random() % 200 : random() % 12;
+      switch (random() % 4) {
+        case 0:
+          for (size_t i = 0; i < length; ++i) {
+            data.push_back(0x20 + static_cast<uint8_t>(random() % 0x5f));
+          }
+          break;
+        case 1:
+          for (size_t i = 0; i < length; ++i) {
+            data.push_back(random() % 8 == 0 ? '\t' : 0x20 + static_cast<uint8_t>(random() % 0x5f));
+            data.push_back(0);
+          }
+          break;
+        case 2:
+          data.insert(data.end(), random() % 3, 0);
+          break;
+        default:
+          for (size_t i = 0; i < length; ++i) {
+            data.push_back(random_byte(random));
+          }
+          break;
+      }
+    }
+    return data;
+  }
+
+  [[nodiscard]] auto same_entry(const strings::entry& lhs, const strings::entry& rhs) -> bool {
+    return lhs.address == rhs.address && lhs.value == rhs.value && lhs.wide == rhs.wide &&
+           lhs.section == rhs.section && lhs.xrefs == rhs.xrefs;
+  }
+
+  [[nodiscard]] auto check(std::span<const uint8_t> data, const strings::options& opts, const char* name) -> bool {
+    const auto expected = reference_scan(data, opts);
+    const auto actual = strings::scan(data, opts);
+    const auto [first, second] = std::ranges::mismatch(expected, actual, same_entry);
+    if (first == expected.end() && second == actual.end()) {
+      return true;
+    }
+    const auto index = static_cast<size_t>(first - expected.begin());
+    std::println(
+      stderr, "{}: {} bytes, min_length {}, wide {}: string {} of {} differs, {} found", name, data.size(),
+      opts.min_length, opts.wide, index, expected.size(), actual.size()
+    );
+    return false;
+  }
+
+} // namespace
+
+// strings::scan classifies 64 byte blocks with word masks and walks runs through bit edges. it has to find exactly
+// the strings the byte loop finds, ascii and utf-16le alike
+int main() {
+  std::mt19937_64 random(0x5a594453);
+  bool passed = true;
+
+  // a run filling whole blocks, and runs ending at, before and after every block edge
+  for (const size_t size : {0, 1, 63, 64, 65, 127, 128, 129, 192, 255, 256, 257}) {
+    for (const auto terminator : {uint8_t{0}, uint8_t{0x7f}}) {
+      std::vector<uint8_t> ascii(size, 'a');
+      std::vector<uint8_t> wide;
+      for (size_t i = 0; i < size; ++i) {
+        wide.push_back('w');
+        wide.push_back(0);
+      }
+      ascii.push_back(terminator);
+      wide.insert(wide.end(), {terminator, 0});
+      for (const auto skip : {size_t{0}, size_t{1}}) {
+        const strings::options opts{.min_length = 1};
+        passed = check(std::span(ascii).subspan(std::min(skip, ascii.size())), opts, "block edge ascii") && passed;
+        passed = check(std::span(wide).subspan(std::min(skip, wide.size())), opts, "block edge wide") && passed;
+      }
+    }
+  }
+
+  for (size_t round = 0; round < 20000; ++round) {
+    const auto data = make_section(random, random() % 700);
+    // a sub span starting at an odd offset moves every word read off its alignment
+    const auto skip = std::min(static_cast<size_t>(random() % 3), data.size());
+    const strings::options opts{.min_length = 1 + random() % 6, .wide = random() % 4 != 0};
+    passed = check(std::span(data).subspan(skip), opts, "random") && passed;
+  }
+
+  std::println("{}", passed ? "string scans match" : "string scans differ");
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,64 @@
+#include <array>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <print>
+#include <string>
+#include "core/serializer.hpp"
+#include "core/view.h"
+#include "random_diff.h"
+
+namespace {
+
+  [[nodiscard]] auto check(const binary_differ::diff_result& expected, const std::filesystem::path& path) -> bool {
+    if (!diff_view::save(expected, path.string())) {
+      std::println(stderr, "{}: failed to save the tables", path.string());
+      return false;
+    }
+
+    bool passed = true;
+    auto report = [&](const char* reader, const binary_differ::diff_result& actual) {
+      if (actual != expected) {
+        const auto difference = random_diff::first_difference(expected, actual);
+        std::println(stderr, "{}: {} differs in {}", path.string(), reader, difference);
+        passed = false;
+      }
+    };
+
+    auto view = diff_view::open(path.string());
+    if (!view) {
+      std::println(stderr, "{}: failed to open the tables: {}", path.string(), view.error());
+      return false;
+    }
+    report("diff_view::materialize", view->materialize());
+
+    // the stream loader hands table files to the view whatever the worker count
+    for (const auto workers : std::array<size_t, 2>{1, 4}) {
+      auto loaded = diff_serializer::load(path.string(), workers);
+      if (!loaded) {
+        std::println(stderr, "{}: diff_serializer::load rejected the tables: {}", path.string(), loaded.error());
+        passed = false;
+        continue;
+      }
+      report("diff_serializer::load", *loaded);
+    }
+    return passed;
+  }
+
+} // namespace
+
+// diff_view::open(diff_view::save(result)).materialize() has to give back result field for field
+int main() {
+  bool passed = true;
+  for (const auto record_count : std::array<size_t, 4>{0, 1, 64, 1000}) {
+    for (uint64_t seed = 0; seed < 4; ++seed) {
+      const auto expected = random_diff::make_diff(seed, record_count);
+      // saved into the working directory, ctest runs every test from its own build directory
+      const std::filesystem::path path(std::format("view_{}_{}.zydt", record_count, seed));
+      passed = check(expected, path) && passed;
+      std::filesystem::remove(path);
+    }
+  }
+  std::println("{}", passed ? "table round trips match" : "table round trips differ");
+  return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}